@@ -0,0 +1,80 @@
+#ifndef DB_ASYNC_HEADER_FILE
+#define DB_ASYNC_HEADER_FILE
+#pragma once
+
+#include <utility>
+#include <optional>
+#include <coroutine>
+#include <functional>
+
+namespace mz {
+    namespace db {
+
+
+        // resumes a coroutine whose table operation completed, e.g. by posting it to a thread
+        // pool or an event loop. an empty one resumes it inline, on the thread reporting the
+        // completion from db_io_ring::wait() or poll().
+        using db_resume = std::function<void(std::coroutine_handle<>)>;
+
+
+        // awaitable returned by the db_table async_ calls, co_await gives true on failure like
+        // the synchronous call. Start(Complete) queues the operation when the coroutine
+        // suspends and Complete(Failed) resumes it. an operation that needs no I/O is ready
+        // and does not suspend at all. co_await it right away, the table has already indexed
+        // the operation when handing it out.
+        template <typename Start>
+        class db_awaitable
+        {
+        public:
+
+            explicit db_awaitable(bool Failed) noexcept : Failed{ Failed }, Done{ true } {}
+            db_awaitable(Start&& Func, db_resume const* Resume) : Begin{ std::move(Func) }, Resume{ Resume } {}
+
+            db_awaitable(db_awaitable&&) = default;
+            db_awaitable& operator = (db_awaitable&&) = delete;
+
+            bool await_ready() const noexcept { return Done; }
+
+            // false when the operation completed before returning, the coroutine goes on
+            bool await_suspend(std::coroutine_handle<> Coroutine)
+            {
+                Handle = Coroutine;
+                Starting = true;
+                (*Begin)([this](bool Result) { complete(Result); });
+                Starting = false;
+                return !Done;
+            }
+
+            bool await_resume() const noexcept { return Failed; }
+
+        private:
+
+            void complete(bool Result)
+            {
+                Failed = Result;
+                Done = true;
+                if (Starting) {
+                    return;
+                }
+                if (Resume && *Resume) {
+                    (*Resume)(Handle);
+                }
+                else {
+                    Handle.resume();
+                }
+            }
+
+            std::optional<Start> Begin{};
+            db_resume const* Resume{ nullptr };
+            std::coroutine_handle<> Handle{};
+            bool Failed{ false };
+            bool Done{ false };
+            bool Starting{ false };
+        };
+
+
+
+    }
+};
+
+#endif
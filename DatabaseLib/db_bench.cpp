@@ -0,0 +1,532 @@
+// benchmarks of the indexes and storage engines, one result per line on stdout as CSV or,
+// with --json, as JSON objects so runs of different versions can be compared.
+//
+//   db_bench [--json] [--rows N] [--folder path]
+//
+// indexes are measured at 1K, 10K, ... keys up to --rows (1M by default, up to 100M),
+// tables and their files up to 1M rows, tables on db_table_segmented up to --rows.
+// files go to --folder, the temporary directory by default, and are removed afterwards.
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <numeric>
+#include <algorithm>
+#include <filesystem>
+
+#include "db_table.h"
+
+namespace mz {
+    namespace db {
+        namespace bench {
+
+
+            struct bench_entry
+            {
+                using key_type = mz::db::row_id;
+
+                key_type Key{};
+                int64_t Value{ 0 };
+                char Payload[48]{};
+
+                key_type& pk() noexcept { return Key; }
+                key_type pk() const noexcept { return Key; }
+                void erase() noexcept { Key.erase(); }
+                bool valid() const noexcept { return Key.valid(); }
+                bool erased() const noexcept { return Key.erased(); }
+            };
+
+
+            // exposes the protected insert of db_table
+            template <template<typename> typename T, template<typename> typename S = mz::db::db_table_file>
+            struct bench_table : mz::db::db_table<bench_entry, T, S>
+            {
+                using base = mz::db::db_table<bench_entry, T, S>;
+                using base::base;
+                using base::insert;
+            };
+
+
+            struct options
+            {
+                bool Json{ false };
+                size_t Rows{ 1000000 };
+                std::filesystem::path Folder{ std::filesystem::temp_directory_path() / "db_bench" };
+            };
+
+
+            class reporter
+            {
+            public:
+
+                explicit reporter(bool Json) noexcept : Json{ Json }
+                {
+                    if (!Json) {
+                        std::printf("bench,target,rows,ops,seconds,ops_per_sec\n");
+                    }
+                }
+
+                void operator () (char const* Bench, char const* Target, size_t Rows, size_t Ops, double Seconds) const
+                {
+                    double Rate = Seconds > 0 ? double(Ops) / Seconds : 0.0;
+                    if (Json) {
+                        std::printf("{\"bench\":\"%s\",\"target\":\"%s\",\"rows\":%zu,\"ops\":%zu,\"seconds\":%.9f,\"ops_per_sec\":%.1f}\n",
+                            Bench, Target, Rows, Ops, Seconds, Rate);
+                    }
+                    else {
+                        std::printf("%s,%s,%zu,%zu,%.9f,%.1f\n", Bench, Target, Rows, Ops, Seconds, Rate);
+                    }
+                    std::fflush(stdout);
+                }
+
+            private:
+                bool Json;
+            };
+
+
+            // seconds spent in Func
+            double timed(auto&& Func)
+            {
+                auto Start = std::chrono::steady_clock::now();
+                Func();
+                return std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+            }
+
+            // ascending committed keys, as row_id hands them out over time
+            inline mz::db::row_id key_at(size_t i) noexcept
+            {
+                return mz::db::row_id{ mz::db::db_time{ int64_t(i + 1) << 8 } };
+            }
+
+            inline std::vector<size_t> shuffled(size_t Count, uint64_t Seed)
+            {
+                std::vector<size_t> Order(Count);
+                std::iota(Order.begin(), Order.end(), size_t(0));
+                std::shuffle(Order.begin(), Order.end(), std::mt19937_64{ Seed });
+                return Order;
+            }
+
+            // keeps the optimizer from dropping the measured loops
+            inline volatile int64_t Sink{ 0 };
+
+            // removes the files of table Name, a segmented one has several
+            inline void remove_table(std::filesystem::path const& Folder, std::string const& Name)
+            {
+                std::error_code Ec;
+                for (auto const& Item : std::filesystem::directory_iterator{ Folder, Ec })
+                {
+                    auto File = Item.path().filename().string();
+                    if (File == Name || File.starts_with(Name + ".")) {
+                        std::filesystem::remove(Item.path(), Ec);
+                    }
+                }
+            }
+
+
+
+            // insert in key order, find and select in random order, then the same finds with
+            // every other key erased. Accelerate turns on the blocked search of an index that
+            // has one before the keys go in.
+            template <template<typename> typename T>
+            void bench_index(reporter const& Report, char const* Target, size_t Rows, bool Accelerate = false)
+            {
+                using map_type = T<mz::db::row_id>;
+                map_type Map;
+                Map.reserve(Rows);
+                if constexpr (requires { Map.accelerate(true); }) {
+                    Map.accelerate(Accelerate);
+                }
+
+                double Seconds = timed([&]
+                    {
+                        for (size_t i = 0; i < Rows; ++i) {
+                            Map.insert(key_at(i), int64_t(i));
+                        }
+                    });
+                Report("index_insert", Target, Rows, Rows, Seconds);
+
+                auto Order = shuffled(Rows, Rows);
+                Seconds = timed([&]
+                    {
+                        int64_t Found{ 0 };
+                        for (size_t i : Order) {
+                            Found += Map.find(key_at(i)) != Map.end();
+                        }
+                        Sink = Found;
+                    });
+                Report("index_find", Target, Rows, Rows, Seconds);
+
+                Seconds = timed([&]
+                    {
+                        int64_t Found{ 0 };
+                        for (size_t i : Order)
+                        {
+                            auto Key = key_at(i);
+                            int64_t Val = int64_t(i);
+                            Found += Map.select(typename map_type::keyval_ref{ Key, Val }) != Map.end();
+                        }
+                        Sink = Found;
+                    });
+                Report("index_select", Target, Rows, Rows, Seconds);
+
+                Seconds = timed([&]
+                    {
+                        for (size_t i = 0; i + 1 < Rows; i += 2)
+                        {
+                            if (auto it = Map.find(key_at(i)); it != Map.end()) {
+                                Map.erase(it);
+                            }
+                        }
+                    });
+                Report("index_erase_half", Target, Rows, Rows / 2, Seconds);
+
+                Seconds = timed([&]
+                    {
+                        int64_t Found{ 0 };
+                        for (size_t i : Order) {
+                            Found += Map.find(key_at(i)) != Map.end();
+                        }
+                        Sink = Found;
+                    });
+                Report("index_find_tombstoned", Target, Rows, Rows, Seconds);
+            }
+
+
+
+            // select and update of single rows in row order and in random order
+            void bench_file(reporter const& Report, std::filesystem::path const& Folder, size_t Rows)
+            {
+                using storage_type = mz::db::db_table_file<bench_entry>;
+                using row_type = storage_type::row_type;
+
+                auto Path = Folder / "bench_file.db";
+                std::filesystem::remove(Path);
+                storage_type Storage;
+                if (Storage.open(Path, Rows + 1))
+                {
+                    std::fprintf(stderr, "db_bench: cannot open %s\n", Path.string().c_str());
+                    return;
+                }
+
+                row_type Row;
+                double Seconds = timed([&]
+                    {
+                        for (size_t i = 0; i < Rows; ++i)
+                        {
+                            Row.Index = int64_t(i);
+                            Row.Entry.Key = key_at(i);
+                            Row.Entry.Value = int64_t(i);
+                            Storage.insert(Row);
+                        }
+                        Storage.sync();
+                    });
+                Report("file_insert", "db_table_file", Rows, Rows, Seconds);
+
+                std::vector<size_t> Sequential(Rows);
+                std::iota(Sequential.begin(), Sequential.end(), size_t(0));
+                auto Random = shuffled(Rows, Rows);
+
+                for (auto [Bench, Order] : { std::pair{ "file_select_seq", &Sequential }, std::pair{ "file_select_rand", &Random } })
+                {
+                    Seconds = timed([&]
+                        {
+                            int64_t Sum{ 0 };
+                            for (size_t i : *Order)
+                            {
+                                Row.Index = int64_t(i);
+                                Storage.select(Row);
+                                Sum += Row.Entry.Value;
+                            }
+                            Sink = Sum;
+                        });
+                    Report(Bench, "db_table_file", Rows, Rows, Seconds);
+                }
+
+                for (auto [Bench, Order] : { std::pair{ "file_update_seq", &Sequential }, std::pair{ "file_update_rand", &Random } })
+                {
+                    Seconds = timed([&]
+                        {
+                            for (size_t i : *Order)
+                            {
+                                Row.Index = int64_t(i);
+                                Row.Entry.Key = key_at(i);
+                                Row.Entry.Value = -int64_t(i);
+                                Storage.update(Row);
+                            }
+                        });
+                    Report(Bench, "db_table_file", Rows, Rows, Seconds);
+                }
+
+                Storage.close();
+                std::filesystem::remove(Path);
+            }
+
+
+
+            // load time against the size of the file, then select and insert on a table with
+            // every other row removed. the keys go back in reverse order so each insert finds
+            // its old row at the back of FreeRows.
+            template <template<typename> typename T, template<typename> typename S = mz::db::db_table_file>
+            void bench_table_load(reporter const& Report, char const* Target, std::filesystem::path const& Folder, size_t Rows)
+            {
+                using table_type = bench_table<T, S>;
+                using row_type = typename table_type::row_type;
+
+                remove_table(Folder, "bench_table");
+                {
+                    table_type Table{ "bench_table" };
+                    if (Table.load(Folder))
+                    {
+                        std::fprintf(stderr, "db_bench: cannot open %s\n", (Folder / "bench_table").string().c_str());
+                        return;
+                    }
+                    row_type Row;
+                    double Seconds = timed([&]
+                        {
+                            for (size_t i = 0; i < Rows; ++i)
+                            {
+                                Row.Entry.Key = key_at(i);
+                                Row.Entry.Value = int64_t(i);
+                                Table.insert(Row);
+                            }
+                        });
+                    Report("table_insert", Target, Rows, Rows, Seconds);
+                    Table.close();
+                }
+
+                // the same rows through insert_bulk, BulkRows at a time
+                remove_table(Folder, "bench_bulk");
+                {
+                    constexpr size_t BulkRows{ 4096 };
+                    table_type Table{ "bench_bulk" };
+                    if (!Table.load(Folder))
+                    {
+                        std::vector<row_type> Bulk;
+                        double Seconds = timed([&]
+                            {
+                                for (size_t i = 0; i < Rows; i += BulkRows)
+                                {
+                                    Bulk.resize(std::min(BulkRows, Rows - i));
+                                    for (size_t j = 0; j < Bulk.size(); ++j)
+                                    {
+                                        Bulk[j].Entry.Key = key_at(i + j);
+                                        Bulk[j].Entry.Value = int64_t(i + j);
+                                    }
+                                    Table.insert_bulk(Bulk);
+                                }
+                            });
+                        Report("table_insert_bulk", Target, Rows, Rows, Seconds);
+                        Table.close();
+                    }
+                }
+                remove_table(Folder, "bench_bulk");
+
+                table_type Table{ "bench_table" };
+                double Seconds = timed([&] { Table.load(Folder); });
+                Report("table_load", Target, Rows, Rows, Seconds);
+
+                auto Order = shuffled(Rows, Rows);
+                row_type Row;
+                Seconds = timed([&]
+                    {
+                        for (size_t i = 0; i + 1 < Rows; i += 2)
+                        {
+                            Row.Index = int64_t(i);
+                            Row.Entry.Key = key_at(i);
+                            Table.remove(Row);
+                        }
+                    });
+                Report("table_remove_half", Target, Rows, Rows / 2, Seconds);
+
+                Seconds = timed([&]
+                    {
+                        int64_t Found{ 0 };
+                        for (size_t i : Order)
+                        {
+                            Row.Index = -1;
+                            Row.Entry.Key = key_at(i);
+                            Found += !Table.select(Row);
+                        }
+                        Sink = Found;
+                    });
+                Report("table_select_tombstoned", Target, Rows, Rows, Seconds);
+
+                Seconds = timed([&]
+                    {
+                        for (size_t Half = Rows / 2; Half-- > 0;)
+                        {
+                            Row.Entry.Key = key_at(2 * Half);
+                            Row.Entry.Value = int64_t(2 * Half);
+                            Table.insert(Row);
+                        }
+                    });
+                Report("table_insert_reuse", Target, Rows, Rows / 2, Seconds);
+
+                Table.close();
+                remove_table(Folder, "bench_table");
+            }
+
+
+
+            // inserts, then updates of every row, committed through write() BatchRows at a time.
+            // the table is then dropped without close(), as by a crash, and load() replays the
+            // write log. true when a row did not come back with its last value.
+            template <template<typename> typename T>
+            bool bench_write(reporter const& Report, char const* Target, std::filesystem::path const& Folder, size_t Rows)
+            {
+                constexpr size_t BatchRows{ 256 };
+                using table_type = bench_table<T>;
+                using row_type = typename table_type::row_type;
+
+                remove_table(Folder, "bench_write");
+                {
+                    table_type Table{ "bench_write" };
+                    if (Table.load(Folder))
+                    {
+                        std::fprintf(stderr, "db_bench: cannot open %s\n", (Folder / "bench_write").string().c_str());
+                        return true;
+                    }
+                    typename table_type::write_batch Batch;
+                    int Res{ 0 };
+                    double Seconds = timed([&]
+                        {
+                            for (size_t i = 0; i < Rows && !Res; i += BatchRows)
+                            {
+                                Batch.clear();
+                                for (size_t j = i; j < std::min(Rows, i + BatchRows); ++j)
+                                {
+                                    bench_entry Entry;
+                                    Entry.Key = key_at(j);
+                                    Entry.Value = int64_t(j);
+                                    Batch.insert(Entry);
+                                }
+                                Res = Table.write(Batch);
+                            }
+                        });
+                    Report("table_write_insert", Target, Rows, Rows, Seconds);
+
+                    Seconds = timed([&]
+                        {
+                            for (size_t i = 0; i < Rows && !Res; i += BatchRows)
+                            {
+                                Batch.clear();
+                                for (size_t j = i; j < std::min(Rows, i + BatchRows); ++j)
+                                {
+                                    row_type Row;
+                                    Row.Index = int64_t(j);
+                                    Row.Entry.Key = key_at(j);
+                                    Row.Entry.Value = -int64_t(j);
+                                    Batch.update(Row);
+                                }
+                                Res = Table.write(Batch);
+                            }
+                        });
+                    Report("table_write_update", Target, Rows, Rows, Seconds);
+                    if (Res)
+                    {
+                        std::fprintf(stderr, "db_bench: %s write error %d\n", Target, Res);
+                        return true;
+                    }
+                }
+
+                table_type Table{ "bench_write" };
+                double Seconds = timed([&] { Table.load(Folder); });
+                Report("table_write_replay", Target, Rows, Rows, Seconds);
+
+                size_t Lost{ 0 };
+                row_type Row;
+                for (size_t i = 0; i < Rows; ++i)
+                {
+                    Row.Index = -1;
+                    Row.Entry.Key = key_at(i);
+                    Lost += Table.select(Row) || Row.Entry.Value != -int64_t(i);
+                }
+                Table.close();
+                remove_table(Folder, "bench_write");
+                if (Lost) {
+                    std::fprintf(stderr, "db_bench: %s lost %zu of %zu rows in the write log replay\n", Target, Lost, Rows);
+                }
+                return Lost != 0;
+            }
+
+
+
+            int run(options const& Options)
+            {
+                std::error_code Ec;
+                std::filesystem::create_directories(Options.Folder, Ec);
+                if (Ec)
+                {
+                    std::fprintf(stderr, "db_bench: cannot create %s\n", Options.Folder.string().c_str());
+                    return 1;
+                }
+
+                reporter Report{ Options.Json };
+                size_t TableRows = std::min<size_t>(Options.Rows, bench_table<mz::db::db_index_lin>::MaxRows - 1);
+
+                for (size_t Rows = 1000; Rows <= Options.Rows; Rows *= 10)
+                {
+                    bench_index<mz::db::db_index_lin>(Report, "db_index_lin", Rows);
+                    bench_index<mz::db::db_index_lin>(Report, "db_index_lin+accelerate", Rows, true);
+                    bench_index<mz::db::db_index_map>(Report, "db_index_map", Rows);
+                    bench_index<mz::db::db_index_hash>(Report, "db_index_hash", Rows);
+                    bench_index<mz::db::db_index_btree>(Report, "db_index_btree", Rows);
+                    bench_index<mz::db::db_index_pgm>(Report, "db_index_pgm", Rows);
+                }
+
+                for (size_t Rows = 1000; Rows <= TableRows; Rows *= 10)
+                {
+                    bench_file(Report, Options.Folder, Rows);
+                    bench_table_load<mz::db::db_index_lin>(Report, "db_index_lin", Options.Folder, Rows);
+                    bench_table_load<mz::db::db_index_map>(Report, "db_index_map", Options.Folder, Rows);
+                    bench_table_load<mz::db::db_index_hash>(Report, "db_index_hash", Options.Folder, Rows);
+                    bench_table_load<mz::db::db_index_btree>(Report, "db_index_btree", Options.Folder, Rows);
+                    bench_table_load<mz::db::db_index_pgm>(Report, "db_index_pgm", Options.Folder, Rows);
+                    if (bench_write<mz::db::db_index_lin>(Report, "db_index_lin", Options.Folder, Rows)
+                        || bench_write<mz::db::db_index_map>(Report, "db_index_map", Options.Folder, Rows)) {
+                        return 1;
+                    }
+                }
+
+                // past the row limit of a single file
+                for (size_t Rows = 1000; Rows <= Options.Rows; Rows *= 10) {
+                    bench_table_load<mz::db::db_index_lin, mz::db::db_table_segmented>(Report, "db_index_lin+segmented", Options.Folder, Rows);
+                    bench_table_load<mz::db::db_index_pgm, mz::db::db_table_segmented>(Report, "db_index_pgm+segmented", Options.Folder, Rows);
+                }
+                return 0;
+            }
+
+
+        }
+    }
+}
+
+
+
+int main(int argc, char** argv)
+{
+    mz::db::bench::options Options;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!std::strcmp(argv[i], "--json")) {
+            Options.Json = true;
+        }
+        else if (!std::strcmp(argv[i], "--rows") && i + 1 < argc) {
+            Options.Rows = std::min<size_t>(std::strtoull(argv[++i], nullptr, 10), 100000000);
+        }
+        else if (!std::strcmp(argv[i], "--folder") && i + 1 < argc) {
+            Options.Folder = argv[++i];
+        }
+        else
+        {
+            std::fprintf(stderr, "usage: db_bench [--json] [--rows N] [--folder path]\n");
+            return 2;
+        }
+    }
+    return mz::db::bench::run(Options);
+}
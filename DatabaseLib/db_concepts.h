@@ -2,7 +2,9 @@
 #define DB_CONCEPTS_HEADER_FILE
 #pragma once
 
+#include <string>
 #include <concepts>
+#include <filesystem>
 #include "time_conversions.h"
 
 namespace mz {
@@ -72,8 +74,33 @@ namespace mz {
 		};
 
 
+		template <typename S>
+		concept StorageType =
+			EntryType<typename S::entry_type> &&
+			requires(S s, S const cs, typename S::row_type r, typename S::entry_type e, std::filesystem::path const& p)
+		{
+			{ r.Index } -> std::convertible_to<int64_t>;
+			{ r.Entry } -> std::convertible_to<typename S::entry_type>;
+
+			{ s.open(p, size_t()) } -> std::same_as<int>;
+			{ s.close() } -> std::same_as<void>;
+			{ s.insert(r) } -> std::same_as<bool>;
+			{ s.update(r) } -> std::same_as<bool>;
+			{ s.update_range(int64_t(), &e, size_t()) } -> std::same_as<bool>;
+			{ s.pop() } -> std::same_as<int64_t>;
+			{ s.sync() } -> std::same_as<bool>;
+
+			{ cs.count() } -> std::same_as<int64_t>;
+			{ cs.select(r) } -> std::same_as<bool>;
+			{ cs.select_range(int64_t(), &e, size_t()) } -> std::same_as<bool>;
+			{ cs.select_next(e) } -> std::same_as<bool>;
+			{ cs.seekg_index(int64_t()) } -> std::same_as<bool>;
+			{ cs.report_errors() } -> std::same_as<std::string>;
+		};
+
+
 	}
 };
 
 
-#endif
\ No newline at end of file
+#endif
\ No newline at end of file
@@ -0,0 +1,334 @@
+#ifndef DB_EVENTS_HEADER_FILE
+#define DB_EVENTS_HEADER_FILE
+#pragma once
+
+#include <mutex>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <format>
+#include <string_view>
+#include <type_traits>
+
+#include "logger.h"
+#include "time_conversions.h"
+#include "db_concepts.h"
+
+namespace mz {
+    namespace db {
+
+
+        // errors of the hot paths that are a normal outcome, a lookup of a missing key or a
+        // row out of bounds, posted through db_events instead of formatted into mz::ErrLog.
+        // failed reads and writes of the storage, and calls on a storage with errors pending,
+        // are not normal and still go straight to mz::ErrLog.
+        enum class db_event : uint8_t {
+            suppressed,             // Arg0 events of code Arg1 were held back by the rate limit
+            dropped,                // Arg0 events were lost to a full ring
+            select_not_found,
+            update_not_found,
+            remove_not_found,
+            async_select_not_found,
+            async_update_not_found,
+            async_remove_not_found,
+            storage_select_fail,
+            storage_update_fail,
+            storage_select_range_fail,
+            storage_update_range_fail,
+            storage_async_select_fail,
+            storage_async_update_fail,
+            storage_out_of_bounds,
+        };
+
+        inline constexpr size_t db_event_count{ size_t(db_event::storage_out_of_bounds) + 1 };
+
+
+        // one posted event, the message is only formatted by string(): {0} is Source, the
+        // table name or the file name of a storage, {1} the key and {2}, {3} are Arg0 and Arg1.
+        struct db_event_record
+        {
+            static constexpr size_t SourceSize{ 24 };
+            static constexpr size_t KeySize{ 16 };
+
+            int64_t Time{ 0 };
+            int64_t Arg0{ 0 };
+            int64_t Arg1{ 0 };
+            std::string(*FormatKey)(void const*) { nullptr };
+            db_event Code{ db_event::dropped };
+            char Source[SourceSize]{};
+            alignas(8) unsigned char Key[KeySize]{};
+
+            static constexpr std::string_view text(db_event Code) noexcept
+            {
+                constexpr std::array<std::string_view, db_event_count> Texts{
+                    "{2} more \"{1}\" events suppressed by the rate limit",
+                    "{2} events lost, event ring full",
+                    "db_table[{0}]::select({1}) not found",
+                    "db_table[{0}]::update({1}) not found",
+                    "db_table[{0}]::remove({1}) not found",
+                    "db_table[{0}]::async_select({1}) not found",
+                    "db_table[{0}]::async_update({1}) not found",
+                    "db_table[{0}]::async_remove({1}) not found",
+                    "storage[{0}]::select_entry(,{2}) fail",
+                    "storage[{0}]::update_entry(,{2}) fail",
+                    "storage[{0}]::select_range({2},{3}) fail",
+                    "storage[{0}]::update_range({2},{3}) fail",
+                    "storage[{0}]::async_select(,{2}) fail",
+                    "storage[{0}]::async_update(,{2}) fail",
+                    "storage[{0}]::good({2}) index out bounds for NumIndexes = {3}",
+                };
+                return Texts[size_t(Code)];
+            }
+
+            std::string string() const
+            {
+                std::string_view Name{ Source, ::strnlen(Source, SourceSize) };
+                std::string KeyText{ FormatKey ? FormatKey(Key) : std::string{} };
+                if (Code == db_event::suppressed && size_t(Arg1) < db_event_count) {
+                    KeyText = text(db_event(Arg1));
+                }
+                return std::format("{}  {}", std::vformat(text(Code), std::make_format_args(Name, KeyText, Arg0, Arg1)), mz::db::db_time{ Time }.string());
+            }
+        };
+
+
+
+        // per thread lock free rings of db_event_record. post() copies the arguments into the
+        // ring of the calling thread, nothing is allocated or formatted; drain() empties all
+        // rings on demand or from a db_event_logger. each code is rate limited per thread to
+        // Burst events a Window, later ones only bump a counter reported by drain().
+        class db_events
+        {
+        public:
+
+            static constexpr size_t RingSize{ 512 };
+            static constexpr uint32_t Burst{ 64 };
+            static constexpr std::chrono::steady_clock::duration Window{ std::chrono::seconds(1) };
+
+
+            static void post(db_event Code, std::string_view Source, int64_t Arg0 = 0, int64_t Arg1 = 0) noexcept
+            {
+                if (admit(Code, Source, Arg0, Arg1)) {
+                    publish();
+                }
+            }
+
+            // Key is copied into the record and formatted with Key.string() by drain()
+            template <typename K>
+                requires (std::is_trivially_copyable_v<K> && sizeof(K) <= db_event_record::KeySize && requires (K k) { k.string(); })
+            static void post(db_event Code, std::string_view Source, K const& Key, int64_t Arg0 = 0, int64_t Arg1 = 0) noexcept
+            {
+                if (auto* Rec = admit(Code, Source, Arg0, Arg1))
+                {
+                    std::memcpy(Rec->Key, &Key, sizeof(K));
+                    Rec->FormatKey = [](void const* Raw) -> std::string
+                        {
+                            K Copy;
+                            std::memcpy(&Copy, Raw, sizeof(K));
+                            return Copy.string();
+                        };
+                    publish();
+                }
+            }
+
+
+            // Func(db_event_record const&) for every event posted so far by any thread, then once
+            // for every code some thread suppressed or dropped since the last drain. returns the
+            // number of records passed to Func. the rings of finished threads are released.
+            static size_t drain(auto&& Func)
+            {
+                auto& R = registry();
+                std::lock_guard Lock{ R.Lock };
+                size_t Count{ 0 };
+                for (auto it = R.Rings.begin(); it != R.Rings.end();)
+                {
+                    ring& Ring = **it;
+                    uint64_t Tail = Ring.Tail.load(std::memory_order_acquire);
+                    for (uint64_t Head = Ring.Head.load(std::memory_order_relaxed); Head != Tail; ++Head)
+                    {
+                        Func(static_cast<db_event_record const&>(Ring.Records[Head % RingSize]));
+                        Ring.Head.store(Head + 1, std::memory_order_release);
+                        ++Count;
+                    }
+
+                    db_event_record Summary{};
+                    Summary.Time = mz::db::db_time::now().tsep;
+                    for (size_t c = 0; c < db_event_count; ++c)
+                    {
+                        uint64_t Total = Ring.Suppressed[c].load(std::memory_order_relaxed);
+                        if (Total != Ring.Reported[c])
+                        {
+                            Summary.Code = db_event::suppressed;
+                            Summary.Arg0 = int64_t(Total - Ring.Reported[c]);
+                            Summary.Arg1 = int64_t(c);
+                            Ring.Reported[c] = Total;
+                            Func(static_cast<db_event_record const&>(Summary));
+                            ++Count;
+                        }
+                    }
+                    if (uint64_t Total = Ring.Dropped.load(std::memory_order_relaxed); Total != Ring.ReportedDrops)
+                    {
+                        Summary.Code = db_event::dropped;
+                        Summary.Arg0 = int64_t(Total - Ring.ReportedDrops);
+                        Summary.Arg1 = 0;
+                        Ring.ReportedDrops = Total;
+                        Func(static_cast<db_event_record const&>(Summary));
+                        ++Count;
+                    }
+
+                    if (Ring.Finished.load(std::memory_order_acquire) && Ring.Head.load(std::memory_order_relaxed) == Ring.Tail.load(std::memory_order_acquire)) {
+                        it = R.Rings.erase(it);
+                    }
+                    else {
+                        ++it;
+                    }
+                }
+                return Count;
+            }
+
+            // formats the pending events into mz::ErrLog
+            static size_t drain_to_log()
+            {
+                return drain([](db_event_record const& Rec) { mz::ErrLog << Rec.string() + "\n"; });
+            }
+
+
+        private:
+
+            struct ring
+            {
+                std::array<db_event_record, RingSize> Records{};
+                alignas(64) std::atomic<uint64_t> Tail{ 0 };    // written by the owner thread
+                alignas(64) std::atomic<uint64_t> Head{ 0 };    // written by drain()
+                std::array<std::atomic<uint64_t>, db_event_count> Suppressed{};
+                std::atomic<uint64_t> Dropped{ 0 };
+                std::atomic<bool> Finished{ false };
+                std::array<uint64_t, db_event_count> Reported{};  // drain() only
+                uint64_t ReportedDrops{ 0 };
+            };
+
+            struct registry_type
+            {
+                std::mutex Lock;
+                std::vector<std::shared_ptr<ring>> Rings;
+            };
+
+            static registry_type& registry()
+            {
+                static registry_type Registry;
+                return Registry;
+            }
+
+            // state of the posting thread, its ring is registered on the first post
+            struct producer
+            {
+                std::shared_ptr<ring> Ring{ std::make_shared<ring>() };
+                std::array<uint32_t, db_event_count> Posted{};
+                std::chrono::steady_clock::time_point WindowStart{ std::chrono::steady_clock::now() };
+
+                producer()
+                {
+                    auto& R = registry();
+                    std::lock_guard Lock{ R.Lock };
+                    R.Rings.push_back(Ring);
+                }
+
+                ~producer() { Ring->Finished.store(true, std::memory_order_release); }
+            };
+
+            static producer& self()
+            {
+                thread_local producer Producer;
+                return Producer;
+            }
+
+            // slot for the next record of the calling thread, nullptr when the event is
+            // suppressed or the ring is full. a suppressed event costs a thread_local lookup
+            // and a counter, the clock is read on every 64th to see if the window is over.
+            static db_event_record* admit(db_event Code, std::string_view Source, int64_t Arg0, int64_t Arg1) noexcept
+            {
+                auto& P = self();
+                ring& Ring = *P.Ring;
+                size_t c = size_t(Code);
+                if (P.Posted[c] >= Burst)
+                {
+                    uint64_t Suppressed = Ring.Suppressed[c].load(std::memory_order_relaxed) + 1;
+                    Ring.Suppressed[c].store(Suppressed, std::memory_order_relaxed);
+                    if (Suppressed % 64 || std::chrono::steady_clock::now() - P.WindowStart < Window) {
+                        return nullptr;
+                    }
+                    P.Posted.fill(0);
+                    P.WindowStart = std::chrono::steady_clock::now();
+                }
+                else if (auto Now = std::chrono::steady_clock::now(); Now - P.WindowStart >= Window)
+                {
+                    P.Posted.fill(0);
+                    P.WindowStart = Now;
+                }
+                ++P.Posted[c];
+
+                uint64_t Tail = Ring.Tail.load(std::memory_order_relaxed);
+                if (Tail - Ring.Head.load(std::memory_order_acquire) >= RingSize)
+                {
+                    Ring.Dropped.store(Ring.Dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                    return nullptr;
+                }
+
+                auto& Rec = Ring.Records[Tail % RingSize];
+                Rec.Code = Code;
+                Rec.Time = mz::db::db_time::now().tsep;
+                Rec.Arg0 = Arg0;
+                Rec.Arg1 = Arg1;
+                Rec.FormatKey = nullptr;
+                size_t Size = std::min(Source.size(), db_event_record::SourceSize - 1);
+                std::memcpy(Rec.Source, Source.data(), Size);
+                Rec.Source[Size] = 0;
+                return &Rec;
+            }
+
+            // makes the record admit() handed out visible to drain()
+            static void publish() noexcept
+            {
+                auto& Ring = *self().Ring;
+                Ring.Tail.store(Ring.Tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            }
+        };
+
+
+
+        // drains db_events into mz::ErrLog every Interval on a thread of its own, and once more
+        // when it is destroyed.
+        class db_event_logger
+        {
+        public:
+
+            explicit db_event_logger(std::chrono::milliseconds Interval = std::chrono::milliseconds(200))
+                : Worker{ [Interval](std::stop_token Stop)
+                    {
+                        while (!Stop.stop_requested())
+                        {
+                            db_events::drain_to_log();
+                            std::this_thread::sleep_for(Interval);
+                        }
+                        db_events::drain_to_log();
+                    } }
+            {
+            }
+
+        private:
+            std::jthread Worker;
+        };
+
+
+
+    }
+};
+
+#endif
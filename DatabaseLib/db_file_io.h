@@ -0,0 +1,323 @@
+#ifndef DB_FILE_IO_HEADER_FILE
+#define DB_FILE_IO_HEADER_FILE
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <algorithm>
+#include <filesystem>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+
+namespace mz {
+    namespace db {
+
+
+        // native file handle used by the storage engines for positional I/O and memory
+        // mapping, mz::io::file keeps a single cursor and does not expose its handle.
+        // I/O functions return true on failure, same as mz::io::file.
+        class db_native_file
+        {
+        public:
+
+#ifdef _WIN32
+            using handle_type = HANDLE;
+            static handle_type invalid_handle() noexcept { return INVALID_HANDLE_VALUE; }
+#else
+            using handle_type = int;
+            static constexpr handle_type invalid_handle() noexcept { return -1; }
+#endif
+
+            db_native_file() noexcept = default;
+            db_native_file(db_native_file const&) = delete;
+            db_native_file& operator = (db_native_file const&) = delete;
+
+            db_native_file(db_native_file&& Other) noexcept : Handle{ std::exchange(Other.Handle, invalid_handle()) } {}
+            db_native_file& operator = (db_native_file&& Other) noexcept
+            {
+                if (this != &Other) {
+                    close();
+                    Handle = std::exchange(Other.Handle, invalid_handle());
+                }
+                return *this;
+            }
+
+            ~db_native_file() { close(); }
+
+
+            handle_type handle() const noexcept { return Handle; }
+            bool is_open() const noexcept { return Handle != invalid_handle(); }
+
+
+            // opens Path for reading and writing, creating it if it does not exist.
+            bool create(std::filesystem::path const& Path) noexcept
+            {
+                close();
+#ifdef _WIN32
+                Handle = ::CreateFileW(Path.c_str(), GENERIC_READ | GENERIC_WRITE,
+                    FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                    OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+#else
+                Handle = ::open(Path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+#endif
+                return is_open();
+            }
+
+
+            void close() noexcept
+            {
+                if (is_open()) {
+#ifdef _WIN32
+                    ::CloseHandle(Handle);
+#else
+                    ::close(Handle);
+#endif
+                    Handle = invalid_handle();
+                }
+            }
+
+
+            int64_t size() const noexcept
+            {
+#ifdef _WIN32
+                LARGE_INTEGER Size;
+                return ::GetFileSizeEx(Handle, &Size) ? int64_t(Size.QuadPart) : -1;
+#else
+                struct stat Stat;
+                return ::fstat(Handle, &Stat) ? -1 : int64_t(Stat.st_size);
+#endif
+            }
+
+
+            // positional read of exactly Size bytes, does not use or move any file cursor
+            bool read_at(void* Data, size_t Size, int64_t Offset) const noexcept
+            {
+                auto Ptr = static_cast<char*>(Data);
+                while (Size)
+                {
+#ifdef _WIN32
+                    OVERLAPPED At{};
+                    At.Offset = DWORD(uint64_t(Offset));
+                    At.OffsetHigh = DWORD(uint64_t(Offset) >> 32);
+                    DWORD Done{ 0 };
+                    DWORD Chunk = DWORD(std::min<size_t>(Size, 1u << 30));
+                    if (!::ReadFile(Handle, Ptr, Chunk, &Done, &At) || !Done) {
+                        return true;
+                    }
+#else
+                    ssize_t Done = ::pread(Handle, Ptr, Size, off_t(Offset));
+                    if (Done < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (Done <= 0) {
+                        return true;
+                    }
+#endif
+                    Ptr += Done;
+                    Size -= size_t(Done);
+                    Offset += int64_t(Done);
+                }
+                return false;
+            }
+
+            // positional write of exactly Size bytes, does not use or move any file cursor
+            bool write_at(void const* Data, size_t Size, int64_t Offset) const noexcept
+            {
+                auto Ptr = static_cast<char const*>(Data);
+                while (Size)
+                {
+#ifdef _WIN32
+                    OVERLAPPED At{};
+                    At.Offset = DWORD(uint64_t(Offset));
+                    At.OffsetHigh = DWORD(uint64_t(Offset) >> 32);
+                    DWORD Done{ 0 };
+                    DWORD Chunk = DWORD(std::min<size_t>(Size, 1u << 30));
+                    if (!::WriteFile(Handle, Ptr, Chunk, &Done, &At) || !Done) {
+                        return true;
+                    }
+#else
+                    ssize_t Done = ::pwrite(Handle, Ptr, Size, off_t(Offset));
+                    if (Done < 0 && errno == EINTR) {
+                        continue;
+                    }
+                    if (Done <= 0) {
+                        return true;
+                    }
+#endif
+                    Ptr += Done;
+                    Size -= size_t(Done);
+                    Offset += int64_t(Done);
+                }
+                return false;
+            }
+
+
+            bool resize(int64_t Size) noexcept
+            {
+#ifdef _WIN32
+                FILE_END_OF_FILE_INFO Info;
+                Info.EndOfFile.QuadPart = Size;
+                return !::SetFileInformationByHandle(Handle, FileEndOfFileInfo, &Info, sizeof(Info));
+#else
+                return ::ftruncate(Handle, off_t(Size)) != 0;
+#endif
+            }
+
+            // resizes the file to Size bytes with disk space reserved for all of them, so
+            // later writes inside it neither allocate blocks nor change the file size.
+            // falls back to resize() where the file system cannot reserve space.
+            bool allocate(int64_t Size) noexcept
+            {
+#if defined(_WIN32)
+                FILE_ALLOCATION_INFO Info;
+                Info.AllocationSize.QuadPart = Size;
+                ::SetFileInformationByHandle(Handle, FileAllocationInfo, &Info, sizeof(Info));
+                return resize(Size);
+#elif defined(__APPLE__)
+                return resize(Size);
+#else
+                int Res = ::posix_fallocate(Handle, 0, off_t(Size));
+                if (Res == EINVAL || Res == EOPNOTSUPP) {
+                    return resize(Size);
+                }
+                return Res != 0;
+#endif
+            }
+
+
+            // flushes data and metadata
+            bool sync() noexcept
+            {
+#ifdef _WIN32
+                return !::FlushFileBuffers(Handle);
+#else
+                return ::fsync(Handle) != 0;
+#endif
+            }
+
+            // flushes data, metadata only when needed to read the data back
+            bool datasync() noexcept
+            {
+#if defined(_WIN32)
+                return !::FlushFileBuffers(Handle);
+#elif defined(__APPLE__)
+                return ::fsync(Handle) != 0;
+#else
+                return ::fdatasync(Handle) != 0;
+#endif
+            }
+
+
+        private:
+
+            handle_type Handle{ invalid_handle() };
+
+        };
+
+
+
+
+
+        // shared read/write view of the first Length bytes of a db_native_file.
+        // the file has to be at least Length bytes long before mapping.
+        class db_file_view
+        {
+        public:
+
+            db_file_view() noexcept = default;
+            db_file_view(db_file_view const&) = delete;
+            db_file_view& operator = (db_file_view const&) = delete;
+
+            ~db_file_view() { unmap(); }
+
+
+            std::byte* data() const noexcept { return Data; }
+            size_t size() const noexcept { return Length; }
+            bool mapped() const noexcept { return Data != nullptr; }
+
+
+            bool map(db_native_file const& File, size_t Size) noexcept
+            {
+                unmap();
+                if (!Size) {
+                    return true;
+                }
+#ifdef _WIN32
+                ULARGE_INTEGER Max;
+                Max.QuadPart = Size;
+                HANDLE Mapping = ::CreateFileMappingW(File.handle(), nullptr, PAGE_READWRITE, Max.HighPart, Max.LowPart, nullptr);
+                if (!Mapping) {
+                    return false;
+                }
+                void* Ptr = ::MapViewOfFile(Mapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, Size);
+                ::CloseHandle(Mapping);
+                if (!Ptr) {
+                    return false;
+                }
+#else
+                void* Ptr = ::mmap(nullptr, Size, PROT_READ | PROT_WRITE, MAP_SHARED, File.handle(), 0);
+                if (Ptr == MAP_FAILED) {
+                    return false;
+                }
+#endif
+                Data = static_cast<std::byte*>(Ptr);
+                Length = Size;
+                return true;
+            }
+
+
+            void unmap() noexcept
+            {
+                if (Data) {
+#ifdef _WIN32
+                    ::UnmapViewOfFile(Data);
+#else
+                    ::munmap(Data, Length);
+#endif
+                    Data = nullptr;
+                    Length = 0;
+                }
+            }
+
+
+            // writes dirty pages of the view back to the file, returns true on failure.
+            bool flush() const noexcept
+            {
+                if (!Data) {
+                    return false;
+                }
+#ifdef _WIN32
+                return !::FlushViewOfFile(Data, Length);
+#else
+                return ::msync(Data, Length, MS_SYNC) != 0;
+#endif
+            }
+
+
+        private:
+
+            std::byte* Data{ nullptr };
+            size_t Length{ 0 };
+
+        };
+
+
+
+    }
+};
+
+
+#endif
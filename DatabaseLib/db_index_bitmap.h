@@ -0,0 +1,250 @@
+#ifndef DB_INDEX_BITMAP_HEADER_FILE
+#define DB_INDEX_BITMAP_HEADER_FILE
+#pragma once
+
+#include <bit>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+namespace mz {
+	namespace db {
+
+
+		// one bit a row, set while the row is live, beside the key array of an index that
+		// keeps tombstones. rows are counted a Block of 512 at a time: Counts holds the live
+		// rows of every block and a Fenwick tree over the full blocks gives the live rows
+		// before any of them, so rank and select cost O(log blocks) plus a few popcounts.
+		// the last block is not in the tree until it is full, appending is O(1).
+		// next() skips blocks without live rows through Counts, a long tombstone run is
+		// passed over without reading its words, let alone its keys.
+		class db_live_bitmap
+		{
+		public:
+
+			static constexpr size_t Block{ 512 };
+			static constexpr size_t Words{ Block / 64 };
+
+			db_live_bitmap() noexcept = default;
+
+
+			size_t size() const noexcept { return Size; }
+			size_t live() const noexcept { return Live; }
+
+			bool test(size_t Pos) const noexcept { return (Bits[Pos / 64] >> (Pos % 64)) & 1; }
+
+
+			void push_back(bool Set)
+			{
+				if (Size % Block == 0)
+				{
+					if (Size) {
+						seal();
+					}
+					Counts.push_back(0);
+				}
+				if (Size % 64 == 0) {
+					Bits.push_back(0);
+				}
+				++Size;
+				if (Set) {
+					flip(Size - 1, true);
+				}
+			}
+
+			void pop_back() noexcept
+			{
+				set(Size - 1, false);
+				--Size;
+				if (Size % 64 == 0) {
+					Bits.pop_back();
+				}
+				if (Size % Block == 0)
+				{
+					Counts.pop_back();
+					if (Size) {
+						Tree.pop_back();
+					}
+				}
+			}
+
+			void set(size_t Pos, bool Set) noexcept
+			{
+				if (test(Pos) != Set) {
+					flip(Pos, Set);
+				}
+			}
+
+			void clear() noexcept
+			{
+				Bits.clear();
+				Counts.clear();
+				Tree.clear();
+				Size = 0;
+				Live = 0;
+			}
+
+			void reserve(size_t Count)
+			{
+				Bits.reserve(Count / 64 + 1);
+				Counts.reserve(Count / Block + 1);
+				Tree.reserve(Count / Block + 1);
+			}
+
+
+			// live rows in [0, Pos)
+			size_t rank(size_t Pos) const noexcept
+			{
+				size_t B = std::min(Pos / Block, Tree.size());
+				size_t Sum = prefix(B);
+				size_t W = B * Words;
+				for (; W < Pos / 64; ++W) {
+					Sum += size_t(std::popcount(Bits[W]));
+				}
+				if (Pos % 64) {
+					Sum += size_t(std::popcount(Bits[W] & ((uint64_t(1) << (Pos % 64)) - 1)));
+				}
+				return Sum;
+			}
+
+			// live rows in [From, To)
+			size_t count(size_t From, size_t To) const noexcept { return From < To ? rank(To) - rank(From) : 0; }
+
+			// position of the live row with rank N, size() when there are not that many
+			size_t select(size_t N) const noexcept
+			{
+				if (N >= Live) {
+					return Size;
+				}
+				// descend the tree for the last full block whose prefix is not above N
+				size_t B{ 0 };
+				for (size_t Step = std::bit_floor(std::max<size_t>(Tree.size(), 1)); Step; Step /= 2)
+				{
+					if (B + Step <= Tree.size() && Tree[B + Step - 1] <= N)
+					{
+						B += Step;
+						N -= Tree[B - 1];
+					}
+				}
+				for (size_t W = B * Words;; ++W)
+				{
+					size_t Ones = size_t(std::popcount(Bits[W]));
+					if (N < Ones)
+					{
+						uint64_t Word = Bits[W];
+						for (; N; --N) {
+							Word &= Word - 1;
+						}
+						return W * 64 + size_t(std::countr_zero(Word));
+					}
+					N -= Ones;
+				}
+			}
+
+			// first live row at or after Pos, size() when there is none
+			size_t next(size_t Pos) const noexcept
+			{
+				if (Pos >= Size) {
+					return Size;
+				}
+				size_t W = Pos / 64;
+				uint64_t Word = Bits[W] & (~uint64_t(0) << (Pos % 64));
+				for (;;)
+				{
+					if (Word) {
+						return std::min(W * 64 + size_t(std::countr_zero(Word)), Size);
+					}
+					if (++W == Bits.size()) {
+						return Size;
+					}
+					if (W % Words == 0)
+					{
+						size_t B = W / Words;
+						while (B < Counts.size() && !Counts[B]) {
+							++B;
+						}
+						if (B == Counts.size()) {
+							return Size;
+						}
+						W = B * Words;
+					}
+					Word = Bits[W];
+				}
+			}
+
+			// first erased row at or after Pos, size() when there is none
+			size_t next_erased(size_t Pos) const noexcept
+			{
+				if (Pos >= Size) {
+					return Size;
+				}
+				size_t W = Pos / 64;
+				uint64_t Word = ~Bits[W] & (~uint64_t(0) << (Pos % 64));
+				for (;;)
+				{
+					if (Word) {
+						return std::min(W * 64 + size_t(std::countr_zero(Word)), Size);
+					}
+					if (++W == Bits.size()) {
+						return Size;
+					}
+					Word = ~Bits[W];
+				}
+			}
+
+
+		private:
+
+			std::vector<uint64_t> Bits;
+			std::vector<uint16_t> Counts;   // live rows of each block
+			std::vector<uint64_t> Tree;     // Fenwick tree of Counts of the full blocks
+			size_t Size{ 0 };
+			size_t Live{ 0 };
+
+			// live rows of the first N full blocks
+			size_t prefix(size_t N) const noexcept
+			{
+				size_t Sum{ 0 };
+				for (; N; N &= N - 1) {
+					Sum += Tree[N - 1];
+				}
+				return Sum;
+			}
+
+			void flip(size_t Pos, bool Set) noexcept
+			{
+				Bits[Pos / 64] ^= uint64_t(1) << (Pos % 64);
+				size_t B = Pos / Block;
+				if (Set) {
+					++Counts[B];
+					++Live;
+				}
+				else {
+					--Counts[B];
+					--Live;
+				}
+				for (size_t i = B + 1; i <= Tree.size(); i += i & (0 - i)) {
+					Tree[i - 1] += Set ? 1 : uint64_t(-1);
+				}
+			}
+
+			// adds the last block, now full, to the tree
+			void seal()
+			{
+				size_t i = Tree.size() + 1;
+				Tree.push_back(Counts.back() + prefix(i - 1) - prefix(i - (i & (0 - i))));
+			}
+		};
+
+
+
+
+
+
+
+
+
+	}
+};
+
+#endif
@@ -0,0 +1,596 @@
+#ifndef DB_INDEX_BTREE_HEADER_FILE
+#define DB_INDEX_BTREE_HEADER_FILE
+#pragma once
+
+#include <span>
+#include <array>
+#include <vector>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+#include <type_traits>
+#include "time_conversions.h"
+#include "db_concepts.h"
+
+namespace mz {
+	namespace db {
+
+
+		// in memory B+tree, ordered like db_index_map for keys in any order.
+		// keys and rows are kept in contiguous arrays of wide leaves that are linked
+		// for ordered scans, inner nodes hold the lower() key of the first key of
+		// every child but the first.
+		// a leaf that is split while appending to the end of the tree stays full,
+		// so monotone keys fill every leaf. erasing does not merge nodes, a node
+		// is freed once it is empty.
+		template <mz::db::KeyType primary_key>
+		class db_index_btree
+		{
+		public:
+
+			static constexpr bool monotone{ false };
+			static constexpr bool ordered{ true };
+
+			using key_type = primary_key;
+			using value_type = int64_t;
+			using keyval_ref = std::pair<key_type&, value_type&>;
+			using pair_type = std::pair<key_type, value_type>;
+
+			static constexpr uint16_t LeafSlots{ 64 };
+			static constexpr uint16_t InnerSlots{ 64 };
+			static constexpr size_t MaxHeight{ 16 };
+
+			struct leaf
+			{
+				uint16_t Size{ 0 };
+				leaf* Prev{ nullptr };
+				leaf* Next{ nullptr };
+				key_type Keys[LeafSlots];
+				value_type Vals[LeafSlots];
+			};
+
+			struct inner
+			{
+				uint16_t Size{ 0 };
+				key_type Keys[InnerSlots];
+				void* Children[InnerSlots + 1];
+			};
+
+
+			template <bool Const>
+			class basic_iterator
+			{
+			public:
+
+				using value_ref = std::conditional_t<Const, int64_t const&, int64_t&>;
+
+				// it->first, it->second like a std::map iterator
+				struct proxy
+				{
+					key_type const& first;
+					value_ref second;
+					proxy const* operator -> () const noexcept { return this; }
+				};
+
+				using iterator_category = std::forward_iterator_tag;
+				using value_type = std::pair<key_type, int64_t>;
+				using difference_type = std::ptrdiff_t;
+				using reference = proxy;
+				using pointer = proxy;
+
+				basic_iterator() noexcept = default;
+				basic_iterator(leaf* Leaf, uint16_t Pos) noexcept : Leaf{ Leaf }, Pos{ Pos } {}
+				operator basic_iterator<true>() const noexcept requires (!Const) { return { Leaf, Pos }; }
+
+				proxy operator * () const noexcept { return proxy{ Leaf->Keys[Pos], Leaf->Vals[Pos] }; }
+				proxy operator -> () const noexcept { return **this; }
+
+				basic_iterator& operator ++ () noexcept
+				{
+					if (++Pos == Leaf->Size) {
+						Leaf = Leaf->Next;
+						Pos = 0;
+					}
+					return *this;
+				}
+				basic_iterator operator ++ (int) noexcept { auto it = *this; ++*this; return it; }
+
+				friend bool operator == (basic_iterator L, basic_iterator R) noexcept { return L.Leaf == R.Leaf && L.Pos == R.Pos; }
+				friend bool operator != (basic_iterator L, basic_iterator R) noexcept { return !(L == R); }
+
+				leaf* Leaf{ nullptr };
+				uint16_t Pos{ 0 };
+			};
+
+			using iterator = basic_iterator<false>;
+			using const_iterator = basic_iterator<true>;
+			using insert_return_type = std::pair<iterator, bool>;
+
+
+			db_index_btree() noexcept = default;
+			db_index_btree(db_index_btree const&) = delete;
+			db_index_btree& operator = (db_index_btree const&) = delete;
+
+			db_index_btree(db_index_btree&& Other) noexcept { swap(Other); }
+			db_index_btree& operator = (db_index_btree&& Other) noexcept
+			{
+				if (this != &Other) {
+					clear();
+					swap(Other);
+				}
+				return *this;
+			}
+
+			~db_index_btree() { clear(); }
+
+
+
+			iterator lower_bound(key_type Key) noexcept
+			{
+				if (!Root) {
+					return end();
+				}
+				key_type Target = Key.lower();
+				leaf* Leaf = descend(Target, nullptr, nullptr);
+				uint16_t Pos = leaf_lower_bound(Leaf, Target);
+				if (Pos == Leaf->Size) {
+					return iterator{ Leaf->Next, 0 };
+				}
+				return iterator{ Leaf, Pos };
+			}
+
+			iterator upper_bound(key_type Key) noexcept { return lower_bound(Key.next()); }
+
+			iterator find(key_type Key) noexcept
+			{
+				auto it = lower_bound(Key);
+				if (it != end() && it->first == Key) {
+					return it;
+				}
+				else {
+					return end();
+				}
+			}
+
+			iterator select(key_type Key, value_type& Val)
+			{
+				auto it = find(Key);
+				Val = it != end() ? it->second : -1;
+				return it;
+			}
+
+			iterator select(keyval_ref KV)
+			{
+				auto it = find(KV.first);
+				if (it != end()) {
+					KV.first = it->first;
+					KV.second = it->second;
+				}
+				else {
+					KV.first.erase();
+					KV.second = -1;
+				}
+				return it;
+			}
+
+
+			// like db_index_map, Val does not have to be the next row as long as the
+			// caller guarantees no other key refers to it.
+			insert_return_type insert(key_type Key, value_type Val) noexcept
+			{
+				if (Val < 0) {
+					return insert_return_type{ end(), false };
+				}
+				if (!Root) {
+					Root = new leaf{};
+					Height = 0;
+				}
+
+				key_type Target = Key.lower();
+				std::array<inner*, MaxHeight> Path;
+				std::array<uint16_t, MaxHeight> Slot;
+				leaf* Leaf = descend(Target, Path.data(), Slot.data());
+				uint16_t Pos = leaf_lower_bound(Leaf, Target);
+
+				if (Pos < Leaf->Size && Leaf->Keys[Pos] == Key) {
+					return insert_return_type{ iterator{ Leaf, Pos }, false };
+				}
+				if (Pos == Leaf->Size && Leaf->Next && Leaf->Next->Keys[0] == Key) {
+					return insert_return_type{ iterator{ Leaf->Next, 0 }, false };
+				}
+
+				if (Leaf->Size == LeafSlots)
+				{
+					bool Append = !Leaf->Next && Pos == Leaf->Size;
+					uint16_t Keep = Append ? LeafSlots : LeafSlots / 2;
+
+					leaf* Right = new leaf{};
+					Right->Size = uint16_t(Leaf->Size - Keep);
+					std::copy(Leaf->Keys + Keep, Leaf->Keys + Leaf->Size, Right->Keys);
+					std::copy(Leaf->Vals + Keep, Leaf->Vals + Leaf->Size, Right->Vals);
+					Leaf->Size = Keep;
+
+					Right->Prev = Leaf;
+					Right->Next = Leaf->Next;
+					if (Leaf->Next) {
+						Leaf->Next->Prev = Right;
+					}
+					Leaf->Next = Right;
+
+					key_type Separator = Append ? Target : Right->Keys[0].lower();
+					if (Append || Pos > Keep) {
+						Pos = uint16_t(Pos - Keep);
+						Leaf = Right;
+					}
+					insert_separator(Path.data(), Slot.data(), Separator, Right);
+				}
+
+				std::copy_backward(Leaf->Keys + Pos, Leaf->Keys + Leaf->Size, Leaf->Keys + Leaf->Size + 1);
+				std::copy_backward(Leaf->Vals + Pos, Leaf->Vals + Leaf->Size, Leaf->Vals + Leaf->Size + 1);
+				Leaf->Keys[Pos] = Key;
+				Leaf->Vals[Pos] = Val;
+				++Leaf->Size;
+				++Count;
+				LastValue = std::max(LastValue, Val);
+				return insert_return_type{ iterator{ Leaf, Pos }, true };
+			}
+
+
+			// inserts Pairs sorted by key, an empty tree is built bottom up from full
+			// leaves. Validate checks the order and values first. returns true without
+			// changing the tree when a key exists.
+			bool insert_sorted(std::span<pair_type const> Pairs, bool Validate = true)
+			{
+				if (Validate)
+				{
+					for (size_t i = 0; i < Pairs.size(); ++i)
+					{
+						if (Pairs[i].second < 0 || (i && !(Pairs[i - 1].first.upper() < Pairs[i].first.lower()))) {
+							return true;
+						}
+					}
+				}
+				if (!Root) {
+					build(Pairs);
+					return false;
+				}
+
+				value_type OldLast = LastValue;
+				for (size_t i = 0; i < Pairs.size(); ++i)
+				{
+					if (!insert(Pairs[i].first, Pairs[i].second).second)
+					{
+						for (size_t j = 0; j < i; ++j) {
+							erase(find(Pairs[j].first));
+						}
+						LastValue = OldLast;
+						return true;
+					}
+				}
+				return false;
+			}
+
+
+			// Func(Key, Val) in key order
+			void for_each(auto&& Func) const
+			{
+				for (leaf const* Leaf = first_leaf(); Leaf; Leaf = Leaf->Next) {
+					for (uint16_t i = 0; i < Leaf->Size; ++i) { Func(Leaf->Keys[i], Leaf->Vals[i]); }
+				}
+			}
+
+
+			iterator erase(iterator pos) noexcept
+			{
+				leaf* Leaf = pos.Leaf;
+				uint16_t Pos = pos.Pos;
+				key_type Target = Leaf->Keys[Pos].lower();
+				if (Leaf->Vals[Pos] == LastValue) {
+					--LastValue;
+				}
+
+				std::copy(Leaf->Keys + Pos + 1, Leaf->Keys + Leaf->Size, Leaf->Keys + Pos);
+				std::copy(Leaf->Vals + Pos + 1, Leaf->Vals + Leaf->Size, Leaf->Vals + Pos);
+				--Leaf->Size;
+				--Count;
+
+				if (Pos < Leaf->Size) {
+					return iterator{ Leaf, Pos };
+				}
+				iterator Next{ Leaf->Next, 0 };
+				if (!Leaf->Size) {
+					remove_leaf(Leaf, Target);
+				}
+				return Next;
+			}
+
+			bool pop(iterator pos) noexcept
+			{
+				bool is_back = pos->second == LastValue;
+				erase(pos);
+				return is_back;
+			}
+
+
+
+			void clear() noexcept
+			{
+				if (Root) {
+					free_node(Root, Height);
+				}
+				Root = nullptr;
+				Height = 0;
+				Count = 0;
+				LastValue = -1;
+			}
+
+			constexpr void reserve(size_t) noexcept {}
+
+			iterator end() noexcept { return iterator{}; }
+			iterator begin() noexcept { return iterator{ first_leaf(), 0 }; }
+			const_iterator end() const noexcept { return const_iterator{}; }
+			const_iterator begin() const noexcept { return const_iterator{ first_leaf(), 0 }; }
+
+			bool empty() const noexcept { return Count == 0; }
+			size_t size() const noexcept { return Count; }
+
+			const_iterator find(key_type Key) const noexcept { return const_cast<db_index_btree*>(this)->find(Key); }
+			const_iterator lower_bound(key_type Key) const noexcept { return const_cast<db_index_btree*>(this)->lower_bound(Key); }
+			const_iterator upper_bound(key_type Key) const noexcept { return const_cast<db_index_btree*>(this)->upper_bound(Key); }
+			const_iterator select(key_type Key, value_type& Val) const noexcept { return const_cast<db_index_btree*>(this)->select(Key, Val); }
+
+
+			// bytes held by nodes
+			size_t memory() const noexcept { return Root ? node_memory(Root, Height) : 0; }
+
+			void swap(db_index_btree& Other) noexcept
+			{
+				std::swap(Root, Other.Root);
+				std::swap(Height, Other.Height);
+				std::swap(Count, Other.Count);
+				std::swap(LastValue, Other.LastValue);
+			}
+
+
+
+		protected:
+
+			void* Root{ nullptr };
+			size_t Height{ 0 };
+			size_t Count{ 0 };
+			value_type LastValue{ -1 };
+
+
+			// number of separators not greater than Target, the child Target belongs to
+			static uint16_t route(inner const* Node, key_type Target) noexcept
+			{
+				return uint16_t(std::upper_bound(Node->Keys, Node->Keys + Node->Size, Target) - Node->Keys);
+			}
+
+			static uint16_t leaf_lower_bound(leaf const* Leaf, key_type Target) noexcept
+			{
+				return uint16_t(std::lower_bound(Leaf->Keys, Leaf->Keys + Leaf->Size, Target) - Leaf->Keys);
+			}
+
+			// leaf Target belongs to, the inner nodes and child slots on the way are stored in Path/Slot
+			leaf* descend(key_type Target, inner** Path, uint16_t* Slot) const noexcept
+			{
+				void* Node = Root;
+				for (size_t Depth = 0; Depth < Height; ++Depth)
+				{
+					auto Inner = static_cast<inner*>(Node);
+					uint16_t Child = route(Inner, Target);
+					if (Path) {
+						Path[Depth] = Inner;
+						Slot[Depth] = Child;
+					}
+					Node = Inner->Children[Child];
+				}
+				return static_cast<leaf*>(Node);
+			}
+
+			leaf* first_leaf() const noexcept
+			{
+				void* Node = Root;
+				for (size_t Depth = 0; Node && Depth < Height; ++Depth) {
+					Node = static_cast<inner*>(Node)->Children[0];
+				}
+				auto Leaf = static_cast<leaf*>(Node);
+				return Leaf && Leaf->Size ? Leaf : nullptr;
+			}
+
+
+			// adds Child right of the child at Slot[Depth] in every inner node up the path
+			// that has to split, and a new root when the old one splits.
+			void insert_separator(inner** Path, uint16_t* Slot, key_type Separator, void* Child) noexcept
+			{
+				for (size_t Depth = Height; Depth-- > 0;)
+				{
+					inner* Node = Path[Depth];
+					uint16_t At = Slot[Depth];
+
+					if (Node->Size < InnerSlots)
+					{
+						std::copy_backward(Node->Keys + At, Node->Keys + Node->Size, Node->Keys + Node->Size + 1);
+						std::copy_backward(Node->Children + At + 1, Node->Children + Node->Size + 1, Node->Children + Node->Size + 2);
+						Node->Keys[At] = Separator;
+						Node->Children[At + 1] = Child;
+						++Node->Size;
+						return;
+					}
+
+					key_type Keys[InnerSlots + 1];
+					void* Children[InnerSlots + 2];
+					std::copy(Node->Keys, Node->Keys + At, Keys);
+					Keys[At] = Separator;
+					std::copy(Node->Keys + At, Node->Keys + InnerSlots, Keys + At + 1);
+					std::copy(Node->Children, Node->Children + At + 1, Children);
+					Children[At + 1] = Child;
+					std::copy(Node->Children + At + 1, Node->Children + InnerSlots + 1, Children + At + 2);
+
+					// appending to the end keeps the left node full, as for leaves
+					uint16_t Mid = At == InnerSlots ? InnerSlots : InnerSlots / 2;
+					inner* Right = new inner{};
+					Node->Size = Mid;
+					std::copy(Keys, Keys + Mid, Node->Keys);
+					std::copy(Children, Children + Mid + 1, Node->Children);
+					Right->Size = uint16_t(InnerSlots - Mid);
+					std::copy(Keys + Mid + 1, Keys + InnerSlots + 1, Right->Keys);
+					std::copy(Children + Mid + 1, Children + InnerSlots + 2, Right->Children);
+
+					Separator = Keys[Mid];
+					Child = Right;
+				}
+
+				inner* NewRoot = new inner{};
+				NewRoot->Size = 1;
+				NewRoot->Keys[0] = Separator;
+				NewRoot->Children[0] = Root;
+				NewRoot->Children[1] = Child;
+				Root = NewRoot;
+				++Height;
+			}
+
+
+			// fills leaves from Pairs, then every level of inner nodes above them
+			void build(std::span<pair_type const> Pairs)
+			{
+				if (Pairs.empty()) {
+					return;
+				}
+
+				std::vector<void*> Nodes;
+				std::vector<key_type> Firsts;
+				leaf* Prev{ nullptr };
+				for (size_t First = 0; First < Pairs.size(); First += LeafSlots)
+				{
+					leaf* Leaf = new leaf{};
+					Leaf->Size = uint16_t(std::min<size_t>(LeafSlots, Pairs.size() - First));
+					for (uint16_t i = 0; i < Leaf->Size; ++i)
+					{
+						Leaf->Keys[i] = Pairs[First + i].first;
+						Leaf->Vals[i] = Pairs[First + i].second;
+						LastValue = std::max(LastValue, Pairs[First + i].second);
+					}
+					Leaf->Prev = Prev;
+					if (Prev) {
+						Prev->Next = Leaf;
+					}
+					Prev = Leaf;
+					Nodes.push_back(Leaf);
+					Firsts.push_back(Leaf->Keys[0].lower());
+				}
+
+				Height = 0;
+				while (Nodes.size() > 1)
+				{
+					std::vector<void*> Parents;
+					std::vector<key_type> ParentFirsts;
+					for (size_t First = 0; First < Nodes.size(); First += InnerSlots + 1)
+					{
+						inner* Node = new inner{};
+						size_t Children = std::min<size_t>(InnerSlots + 1, Nodes.size() - First);
+						Node->Size = uint16_t(Children - 1);
+						for (size_t i = 0; i < Children; ++i)
+						{
+							Node->Children[i] = Nodes[First + i];
+							if (i) {
+								Node->Keys[i - 1] = Firsts[First + i];
+							}
+						}
+						Parents.push_back(Node);
+						ParentFirsts.push_back(Firsts[First]);
+					}
+					Nodes.swap(Parents);
+					Firsts.swap(ParentFirsts);
+					++Height;
+				}
+				Root = Nodes[0];
+				Count = Pairs.size();
+			}
+
+
+			// unlinks and frees an empty leaf, then every inner node that lost its last child
+			void remove_leaf(leaf* Leaf, key_type Target) noexcept
+			{
+				if (!Height) {
+					return;
+				}
+
+				std::array<inner*, MaxHeight> Path;
+				std::array<uint16_t, MaxHeight> Slot;
+				descend(Target, Path.data(), Slot.data());
+
+				if (Leaf->Prev) {
+					Leaf->Prev->Next = Leaf->Next;
+				}
+				if (Leaf->Next) {
+					Leaf->Next->Prev = Leaf->Prev;
+				}
+				delete Leaf;
+
+				for (size_t Depth = Height; Depth-- > 0;)
+				{
+					inner* Node = Path[Depth];
+					uint16_t At = Slot[Depth];
+					if (!Node->Size)
+					{
+						delete Node;
+						if (!Depth) {
+							Root = nullptr;
+							Height = 0;
+							return;
+						}
+						continue;
+					}
+
+					uint16_t Key = At ? uint16_t(At - 1) : 0;
+					std::copy(Node->Keys + Key + 1, Node->Keys + Node->Size, Node->Keys + Key);
+					std::copy(Node->Children + At + 1, Node->Children + Node->Size + 1, Node->Children + At);
+					--Node->Size;
+					break;
+				}
+
+				while (Height && !static_cast<inner*>(Root)->Size)
+				{
+					auto Old = static_cast<inner*>(Root);
+					Root = Old->Children[0];
+					delete Old;
+					--Height;
+				}
+			}
+
+
+			static void free_node(void* Node, size_t Depth) noexcept
+			{
+				if (!Depth) {
+					delete static_cast<leaf*>(Node);
+					return;
+				}
+				auto Inner = static_cast<inner*>(Node);
+				for (uint16_t i = 0; i <= Inner->Size; ++i) {
+					free_node(Inner->Children[i], Depth - 1);
+				}
+				delete Inner;
+			}
+
+			static size_t node_memory(void* Node, size_t Depth) noexcept
+			{
+				if (!Depth) {
+					return sizeof(leaf);
+				}
+				auto Inner = static_cast<inner*>(Node);
+				size_t Bytes = sizeof(inner);
+				for (uint16_t i = 0; i <= Inner->Size; ++i) {
+					Bytes += node_memory(Inner->Children[i], Depth - 1);
+				}
+				return Bytes;
+			}
+
+		};
+
+
+	}
+};
+
+#endif
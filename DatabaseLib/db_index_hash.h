@@ -0,0 +1,384 @@
+#ifndef DB_INDEX_HASH_HEADER_FILE
+#define DB_INDEX_HASH_HEADER_FILE
+#pragma once
+
+#include <bit>
+#include <span>
+#include <array>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <iterator>
+#include "time_conversions.h"
+#include "db_concepts.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DB_INDEX_HASH_SSE2 1
+#endif
+
+namespace mz {
+	namespace db {
+
+
+		// hashes the bytes of Key.lower(), keys that compare equal have the same
+		// lower() so flag bits do not take part, same as row_id equality.
+		template <mz::db::KeyType K>
+		struct db_key_hash
+		{
+			uint64_t operator () (K Key) const noexcept
+			{
+				auto Bytes = std::bit_cast<std::array<unsigned char, sizeof(K)>>(Key.lower());
+				uint64_t Hash{ 0x9E3779B97F4A7C15ull };
+				for (size_t i = 0; i < sizeof(K); i += sizeof(uint64_t))
+				{
+					uint64_t Word{ 0 };
+					std::memcpy(&Word, Bytes.data() + i, std::min(sizeof(uint64_t), sizeof(K) - i));
+					Hash = mix(Hash ^ Word);
+				}
+				return Hash;
+			}
+
+			static constexpr uint64_t mix(uint64_t X) noexcept
+			{
+				X ^= X >> 33;
+				X *= 0xFF51AFD7ED558CCDull;
+				X ^= X >> 33;
+				X *= 0xC4CEB9FE1A85EC53ull;
+				X ^= X >> 33;
+				return X;
+			}
+		};
+
+
+
+
+		// flat open addressing index, no ordering.
+		// slots are probed a group of 16 at a time: each slot has a control byte holding
+		// 7 bits of its hash, or the empty/deleted markers, and a whole group of control
+		// bytes is matched against the searched hash with one SSE2 compare.
+		template <mz::db::KeyType primary_key>
+		class db_index_hash
+		{
+		public:
+
+			static constexpr bool monotone{ false };
+			static constexpr bool ordered{ false };
+
+			using key_type = primary_key;
+			using value_type = int64_t;
+			using keyval_ref = std::pair<key_type&, value_type&>;
+			using slot_type = std::pair<key_type, value_type>;
+			using pair_type = slot_type;
+
+			static constexpr size_t Group{ 16 };
+			static constexpr int8_t Empty{ -128 };
+			static constexpr int8_t Deleted{ -2 };
+
+
+			template <bool Const>
+			class basic_iterator
+			{
+			public:
+
+				using owner_type = std::conditional_t<Const, db_index_hash const, db_index_hash>;
+				using iterator_category = std::forward_iterator_tag;
+				using value_type = slot_type;
+				using difference_type = std::ptrdiff_t;
+				using reference = std::conditional_t<Const, slot_type const&, slot_type&>;
+				using pointer = std::conditional_t<Const, slot_type const*, slot_type*>;
+
+				basic_iterator() noexcept = default;
+				basic_iterator(owner_type* Owner, size_t Pos) noexcept : Owner{ Owner }, Pos{ Pos } {}
+				operator basic_iterator<true>() const noexcept requires (!Const) { return { Owner, Pos }; }
+
+				reference operator * () const noexcept { return Owner->Slots[Pos]; }
+				pointer operator -> () const noexcept { return &Owner->Slots[Pos]; }
+
+				basic_iterator& operator ++ () noexcept { Pos = Owner->next_full(Pos + 1); return *this; }
+				basic_iterator operator ++ (int) noexcept { auto it = *this; ++*this; return it; }
+
+				friend bool operator == (basic_iterator L, basic_iterator R) noexcept { return L.Pos == R.Pos; }
+				friend bool operator != (basic_iterator L, basic_iterator R) noexcept { return L.Pos != R.Pos; }
+
+				size_t position() const noexcept { return Pos; }
+
+			private:
+
+				owner_type* Owner{ nullptr };
+				size_t Pos{ 0 };
+			};
+
+			using iterator = basic_iterator<false>;
+			using const_iterator = basic_iterator<true>;
+			using insert_return_type = std::pair<iterator, bool>;
+
+			db_index_hash() noexcept = default;
+
+
+
+			iterator find(key_type Key) noexcept
+			{
+				if (Slots.empty()) {
+					return end();
+				}
+
+				uint64_t Hash = db_key_hash<key_type>{}(Key);
+				int8_t Tag = tag(Hash);
+				size_t Groups = Slots.size() / Group;
+				size_t G = group(Hash);
+				for (size_t Step = 1; Step <= Groups; ++Step)
+				{
+					for (uint32_t Mask = match(G, Tag); Mask; Mask &= Mask - 1)
+					{
+						size_t Pos = G * Group + size_t(std::countr_zero(Mask));
+						if (Slots[Pos].first == Key) {
+							return iterator{ this, Pos };
+						}
+					}
+					if (match(G, Empty)) {
+						break;
+					}
+					G = (G + Step) & (Groups - 1);
+				}
+				return end();
+			}
+
+			iterator select(key_type Key, value_type& Val)
+			{
+				auto it = find(Key);
+				Val = it != end() ? it->second : -1;
+				return it;
+			}
+
+			iterator select(keyval_ref KV)
+			{
+				auto it = find(KV.first);
+				if (it != end()) {
+					KV.first = it->first;
+					KV.second = it->second;
+				}
+				else {
+					KV.first.erase();
+					KV.second = -1;
+				}
+				return it;
+			}
+
+
+			// like db_index_map, Val does not have to be the next row as long as the
+			// caller guarantees no other key refers to it.
+			insert_return_type insert(key_type Key, value_type Val) noexcept
+			{
+				if (Val < 0) {
+					return insert_return_type{ end(), false };
+				}
+
+				if (auto it = find(Key); it != end()) {
+					return insert_return_type{ it, false };
+				}
+
+				if ((Count + Tombs + 1) * 8 > Slots.size() * 7) {
+					rehash(std::max(Count * 2, Group));
+				}
+
+				uint64_t Hash = db_key_hash<key_type>{}(Key);
+				size_t Pos = free_slot(Hash);
+				if (Ctrl[Pos] == Deleted) {
+					--Tombs;
+				}
+				Ctrl[Pos] = tag(Hash);
+				Slots[Pos] = slot_type{ Key, Val };
+				++Count;
+				LastValue = std::max(LastValue, Val);
+				return insert_return_type{ iterator{ this, Pos }, true };
+			}
+
+			// Pairs are inserted after one reserve. the hash index does not need their order,
+			// Validate checks it anyway, as the ordered indexes do, with every Val >= 0.
+			// returns true without changing the index when a key exists or a check fails.
+			bool insert_sorted(std::span<pair_type const> Pairs, bool Validate = true)
+			{
+				if (Validate)
+				{
+					for (size_t i = 0; i < Pairs.size(); ++i)
+					{
+						if (Pairs[i].second < 0 || (i && !(Pairs[i - 1].first.upper() < Pairs[i].first.lower()))) {
+							return true;
+						}
+					}
+				}
+
+				value_type OldLast = LastValue;
+				reserve(Count + Pairs.size());
+				for (size_t i = 0; i < Pairs.size(); ++i)
+				{
+					if (!insert(Pairs[i].first, Pairs[i].second).second)
+					{
+						for (size_t j = 0; j < i; ++j) {
+							erase(find(Pairs[j].first));
+						}
+						LastValue = OldLast;
+						return true;
+					}
+				}
+				return false;
+			}
+
+			// Func(Key, Val) in slot order
+			void for_each(auto&& Func) const
+			{
+				for (size_t i = 0; i < Ctrl.size(); ++i) {
+					if (Ctrl[i] >= 0) { Func(Slots[i].first, Slots[i].second); }
+				}
+			}
+
+			iterator erase(iterator pos) noexcept
+			{
+				size_t Pos = pos.position();
+				if (Slots[Pos].second == LastValue) {
+					--LastValue;
+				}
+				Ctrl[Pos] = Deleted;
+				--Count;
+				++Tombs;
+				return iterator{ this, next_full(Pos + 1) };
+			}
+
+			bool pop(iterator pos) noexcept
+			{
+				bool is_back = pos->second == LastValue;
+				erase(pos);
+				return is_back;
+			}
+
+
+
+			std::vector<int8_t> Ctrl{};
+			std::vector<slot_type> Slots{};
+			size_t Count{ 0 };
+			size_t Tombs{ 0 };
+			value_type LastValue{ -1 };
+
+			void clear() noexcept
+			{
+				std::fill(Ctrl.begin(), Ctrl.end(), Empty);
+				Count = 0;
+				Tombs = 0;
+				LastValue = -1;
+			}
+
+			void reserve(size_t Rows)
+			{
+				if (Rows * 8 > Slots.size() * 7) {
+					rehash(Rows);
+				}
+			}
+
+			iterator end() noexcept { return iterator{ this, Slots.size() }; }
+			iterator begin() noexcept { return iterator{ this, next_full(0) }; }
+			const_iterator end() const noexcept { return const_iterator{ this, Slots.size() }; }
+			const_iterator begin() const noexcept { return const_iterator{ this, next_full(0) }; }
+
+			bool empty() const noexcept { return Count == 0; }
+			size_t size() const noexcept { return Count; }
+
+			const_iterator find(key_type Key) const noexcept { return const_cast<db_index_hash*>(this)->find(Key); }
+			const_iterator select(key_type Key, value_type& Val) const noexcept { return const_cast<db_index_hash*>(this)->select(Key, Val); }
+
+
+
+		protected:
+
+
+			static int8_t tag(uint64_t Hash) noexcept { return int8_t(Hash >> 57); }
+			size_t group(uint64_t Hash) const noexcept { return size_t(Hash) & (Slots.size() / Group - 1); }
+
+
+			// bit i set when control byte i of group G equals Tag
+			uint32_t match(size_t G, int8_t Tag) const noexcept
+			{
+				int8_t const* Bytes = Ctrl.data() + G * Group;
+#ifdef DB_INDEX_HASH_SSE2
+				__m128i Ctl = _mm_loadu_si128(reinterpret_cast<__m128i const*>(Bytes));
+				return uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(Ctl, _mm_set1_epi8(Tag))));
+#else
+				uint32_t Mask{ 0 };
+				for (size_t i = 0; i < Group; ++i) {
+					Mask |= uint32_t(Bytes[i] == Tag) << i;
+				}
+				return Mask;
+#endif
+			}
+
+			// bit i set when slot i of group G is empty or deleted, both have the top bit set
+			uint32_t match_free(size_t G) const noexcept
+			{
+				int8_t const* Bytes = Ctrl.data() + G * Group;
+#ifdef DB_INDEX_HASH_SSE2
+				return uint32_t(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const*>(Bytes))));
+#else
+				uint32_t Mask{ 0 };
+				for (size_t i = 0; i < Group; ++i) {
+					Mask |= uint32_t(Bytes[i] < 0) << i;
+				}
+				return Mask;
+#endif
+			}
+
+			size_t free_slot(uint64_t Hash) const noexcept
+			{
+				size_t Groups = Slots.size() / Group;
+				size_t G = group(Hash);
+				for (size_t Step = 1;; ++Step)
+				{
+					if (uint32_t Mask = match_free(G)) {
+						return G * Group + size_t(std::countr_zero(Mask));
+					}
+					G = (G + Step) & (Groups - 1);
+				}
+			}
+
+			size_t next_full(size_t Pos) const noexcept
+			{
+				while (Pos < Ctrl.size() && Ctrl[Pos] < 0) {
+					++Pos;
+				}
+				return Pos;
+			}
+
+
+			// resizes to a power of two number of groups holding Rows at 7/8 load
+			void rehash(size_t Rows)
+			{
+				size_t Groups{ 1 };
+				while (Groups * Group * 7 < Rows * 8) {
+					Groups *= 2;
+				}
+
+				std::vector<int8_t> OldCtrl(Groups * Group, Empty);
+				std::vector<slot_type> OldSlots(Groups * Group);
+				OldCtrl.swap(Ctrl);
+				OldSlots.swap(Slots);
+				Tombs = 0;
+
+				for (size_t i = 0; i < OldCtrl.size(); ++i)
+				{
+					if (OldCtrl[i] >= 0)
+					{
+						uint64_t Hash = db_key_hash<key_type>{}(OldSlots[i].first);
+						size_t Pos = free_slot(Hash);
+						Ctrl[Pos] = tag(Hash);
+						Slots[Pos] = OldSlots[i];
+					}
+				}
+			}
+
+		};
+
+
+	}
+};
+
+#endif
@@ -2,9 +2,14 @@
 #define DB_INDEX_LIN_HEADER_FILE
 #pragma once
 
+#include <span>
+#include <utility>
 #include <algorithm>
+#include <type_traits>
 #include "time_conversions.h"
 #include "db_concepts.h"
+#include "db_index_search.h"
+#include "db_index_bitmap.h"
 
 namespace mz {
 	namespace db {
@@ -16,27 +21,56 @@ namespace mz {
 		public:
 
 			static constexpr bool monotone{ true };
+			static constexpr bool ordered{ true };
 
 			using key_type = primary_key;
 			using value_type = int64_t;
 			using keyval_ref = std::pair<key_type&, value_type&>;
+			using pair_type = std::pair<key_type, value_type>;
 
 			using indexer = std::vector<key_type>;
 			using iterator = indexer::iterator;
 			using const_iterator = indexer::const_iterator;
 			using insert_return_type = std::pair<iterator, bool>;
 
+			// keys that are a single signed 64 bit Key ordered by its value, like row_id,
+			// can be searched through db_blocked_search instead of a binary search.
+			static constexpr bool searchable{
+				sizeof(key_type) == sizeof(int64_t) && std::is_standard_layout_v<key_type> &&
+				requires (key_type k) { { k.Key } -> std::convertible_to<int64_t>; } };
+
 			db_index_lin() noexcept = default;
 
 
 
 			iterator lower_bound(key_type Key) noexcept
 			{
+				if constexpr (searchable)
+				{
+					if (Search.enabled()) {
+						return Rows.begin() + Search.lower_bound(raw(), Rows.size(), Key.lower().Key);
+					}
+				}
 				return std::lower_bound(
 					Rows.begin(), Rows.end(), Key.lower(),
 					[](key_type L, key_type R) constexpr noexcept -> bool { return L < R; });
 			}
 
+
+			// turns the blocked search on or off, it is kept up to date while keys are appended.
+			void accelerate(bool Enable)
+			{
+				if constexpr (searchable)
+				{
+					if (Enable) {
+						Search.enable(raw(), Rows.size());
+					}
+					else {
+						Search.disable();
+					}
+				}
+			}
+
 			iterator upper_bound(key_type Key) noexcept { return lower_bound(Key.next()); }
 
 			iterator find(key_type Key) noexcept
@@ -76,12 +110,30 @@ namespace mz {
 			}
 
 
+			// appends at Val == size(), or reuses an erased row when Key still falls
+			// between the keys of its neighbours so the rows stay sorted.
 			insert_return_type insert(key_type Key, value_type Val) noexcept
 			{
 				if (Val == size() && (LastKey < Key))
 				{
 					Rows.push_back(Key);
+					Live.push_back(!Key.erased());
 					LastKey = Key.upper();
+					if constexpr (searchable) {
+						if (Search.enabled()) { Search.push_back(raw(), Rows.size()); }
+					}
+					return insert_return_type{ Rows.begin() + Val, true };
+				}
+				else if (reusable(Key, Val))
+				{
+					Rows[Val] = Key;
+					Live.set(size_t(Val), !Key.erased());
+					if (size_t(Val) + 1 == Rows.size()) {
+						LastKey = Key.upper();
+					}
+					if constexpr (searchable) {
+						if (Search.enabled()) { Search.assign(raw(), size_t(Val)); }
+					}
 					return insert_return_type{ Rows.begin() + Val, true };
 				}
 				else {
@@ -89,20 +141,78 @@ namespace mz {
 				}
 			}
 
+			// appends Pairs, which have to continue the rows in order: Val is the next row
+			// and every key is greater than the one before. Validate checks that first and
+			// returns true without inserting anything when it does not hold.
+			bool insert_sorted(std::span<pair_type const> Pairs, bool Validate = true)
+			{
+				if (Validate)
+				{
+					key_type Last = LastKey;
+					size_t Next = Rows.size();
+					for (auto& [Key, Val] : Pairs)
+					{
+						if (Val < 0 || size_t(Val) != Next++ || !(Last < Key)) {
+							return true;
+						}
+						Last = Key.upper();
+					}
+				}
+				if (Pairs.empty()) {
+					return false;
+				}
+
+				size_t First = Rows.size();
+				Rows.reserve(First + Pairs.size());
+				Live.reserve(First + Pairs.size());
+				for (auto& KV : Pairs)
+				{
+					Rows.push_back(KV.first);
+					Live.push_back(!KV.first.erased());
+				}
+				LastKey = Rows.back().upper();
+				if constexpr (searchable) {
+					if (Search.enabled()) {
+						for (size_t i = First + 1; i <= Rows.size(); ++i) { Search.push_back(raw(), i); }
+					}
+				}
+				return false;
+			}
+
+			// Func(Key, Val) for every row, erased ones included
+			void for_each(auto&& Func) const
+			{
+				for (size_t i = 0; i < Rows.size(); ++i) {
+					Func(Rows[i], value_type(i));
+				}
+			}
+
+			bool reusable(key_type Key, value_type Val) const noexcept
+			{
+				size_t Index = size_t(Val);
+				return Val >= 0 && Index < Rows.size() && Rows[Index].erased()
+					&& (Index == 0 || Rows[Index - 1].lower() < Key.lower())
+					&& (Index + 1 == Rows.size() || Key.upper() < Rows[Index + 1].lower());
+			}
+
 			iterator erase(iterator pos) noexcept
 			{
 				if (pos != --end())
 				{
-					pos->erase();
+					tombstone(pos);
 					return ++pos;
 				}
 				Rows.pop_back();
+				Live.pop_back();
 				if (!Rows.empty()) {
 					LastKey = Rows.back();
 				}
 				else {
 					LastKey.clear();
 				}
+				if constexpr (searchable) {
+					Search.truncate(Rows.size());
+				}
 				return end();
 			}
 
@@ -110,27 +220,88 @@ namespace mz {
 			{
 				if (pos != --end())
 				{
-					pos->erase();
+					tombstone(pos);
 					return false;
 				}
 				Rows.pop_back();
+				Live.pop_back();
 				if (!Rows.empty()) {
 					LastKey = Rows.back();
 				}
 				else {
 					LastKey.clear();
 				}
+				if constexpr (searchable) {
+					Search.truncate(Rows.size());
+				}
 				return true;
 			}
 
+			// erases the key at pos and keeps it as a tombstone, also the last one
+			void tombstone(iterator pos) noexcept
+			{
+				pos->erase();
+				Live.set(size_t(pos - Rows.begin()), false);
+			}
+
+
+			// keys not erased, without walking Rows
+			size_t live() const noexcept { return Live.live(); }
+
+			// keys not erased in [From, To]
+			size_t count(key_type From, key_type To) const noexcept
+			{
+				if (To < From) {
+					return 0;
+				}
+				return Live.count(size_t(lower_bound(From) - begin()), size_t(upper_bound(To) - begin()));
+			}
+
+			// first key not erased at or after pos
+			iterator next_live(iterator pos) noexcept { return Rows.begin() + Live.next(size_t(pos - Rows.begin())); }
+			const_iterator next_live(const_iterator pos) const noexcept { return Rows.begin() + Live.next(size_t(pos - Rows.begin())); }
+
+			// Func(Key, Val) for every row not erased, runs of erased rows are skipped
+			// through the live bitmap without reading their keys
+			void for_each_live(auto&& Func) const
+			{
+				for (size_t i = Live.next(0); i < Rows.size(); i = Live.next(i + 1)) {
+					Func(Rows[i], value_type(i));
+				}
+			}
+
+			// Func(First, Count) for the runs of rows in [From, To) holding a key not erased,
+			// runs less than Gap rows apart are joined
+			void live_runs(size_t From, size_t To, size_t Gap, auto&& Func) const
+			{
+				To = std::min(To, Rows.size());
+				size_t First = Live.next(From);
+				while (First < To)
+				{
+					size_t Last = std::min(Live.next_erased(First), To);
+					size_t Next = Live.next(Last);
+					while (Next < To && Next - Last < Gap)
+					{
+						Last = std::min(Live.next_erased(Next), To);
+						Next = Live.next(Last);
+					}
+					Func(First, Last - First);
+					First = Next;
+				}
+			}
+
 
 			indexer Rows{};
 			key_type LastKey{};
+			db_blocked_search Search{};
+			db_live_bitmap Live{};
+
+			int64_t const* raw() const noexcept { return reinterpret_cast<int64_t const*>(Rows.data()); }
 
-			constexpr void clear() noexcept { Rows.clear(); }
+			constexpr void clear() noexcept { Rows.clear(); Live.clear(); LastKey.clear(); Search.truncate(0); }
 			constexpr iterator end() noexcept { return Rows.end(); }
 			constexpr iterator begin() noexcept { return Rows.begin(); }
-			constexpr void reserve(size_t Count) noexcept { Rows.reserve(Count); }
+			void reserve(size_t Count) { Rows.reserve(Count); Live.reserve(Count); }
 
 			constexpr bool empty() const noexcept { return Rows.empty(); }
 			constexpr size_t size() const noexcept { return Rows.size(); }
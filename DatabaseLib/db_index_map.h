@@ -3,6 +3,9 @@
 #pragma once
 
 #include <map>
+#include <span>
+#include <utility>
+#include <algorithm>
 #include "time_conversions.h"
 #include "db_concepts.h"
 
@@ -16,11 +19,13 @@ namespace mz {
 		public:
 
 			static constexpr bool monotone{ false };
+			static constexpr bool ordered{ true };
 
 
 			using key_type = primary_key;
 			using value_type = int64_t;
 			using keyval_ref = std::pair<key_type&, value_type&>;
+			using pair_type = std::pair<key_type, value_type>;
 
 			using indexer = std::map<key_type, value_type>;
 			using iterator = indexer::iterator;
@@ -68,9 +73,11 @@ namespace mz {
 
 
 
+			// Val does not have to be the next row, a reused row is accepted as long as
+			// the caller guarantees no other key refers to it.
 			insert_return_type insert(key_type Key, value_type Val) noexcept
 			{
-				if (LastValue + 1 != Val)
+				if (Val < 0)
 				{
 					return insert_return_type{ upper_bound(Key), false };
 				}
@@ -83,13 +90,58 @@ namespace mz {
 				else
 				{
 					it = Map.insert(it, { Key, Val });
-					if (it->second == Val) {
-						LastValue = Val;
-						return insert_return_type{ it, true };
+					LastValue = std::max(LastValue, Val);
+					return insert_return_type{ it, true };
+				}
+			}
+
+			// inserts Pairs sorted by key, each one placed right after the one before so a
+			// load into an empty map takes constant time per key. Validate checks the order
+			// and values first. returns true without changing the map when a key exists.
+			bool insert_sorted(std::span<pair_type const> Pairs, bool Validate = true)
+			{
+				if (Validate)
+				{
+					for (size_t i = 0; i < Pairs.size(); ++i)
+					{
+						if (Pairs[i].second < 0 || (i && !(Pairs[i - 1].first.upper() < Pairs[i].first.lower()))) {
+							return true;
+						}
 					}
-					else {
-						return insert_return_type{ it, false };
+				}
+
+				value_type OldLast = LastValue;
+				auto Hint = Map.end();
+				if (!Pairs.empty()) {
+					Hint = lower_bound(Pairs.front().first);
+				}
+				for (size_t i = 0; i < Pairs.size(); ++i)
+				{
+					size_t Before = Map.size();
+					auto it = Map.emplace_hint(Hint, Pairs[i].first, Pairs[i].second);
+					if (Map.size() == Before || (it != Map.begin() && std::prev(it)->first == Pairs[i].first)
+						|| (std::next(it) != Map.end() && std::next(it)->first == Pairs[i].first))
+					{
+						if (Map.size() != Before) {
+							Map.erase(it);
+						}
+						for (size_t j = 0; j < i; ++j) {
+							Map.erase(Map.find(Pairs[j].first));
+						}
+						LastValue = OldLast;
+						return true;
 					}
+					Hint = std::next(it);
+					LastValue = std::max(LastValue, Pairs[i].second);
+				}
+				return false;
+			}
+
+			// Func(Key, Val) in key order
+			void for_each(auto&& Func) const
+			{
+				for (auto& [Key, Val] : Map) {
+					Func(Key, Val);
 				}
 			}
 
@@ -0,0 +1,506 @@
+#ifndef DB_INDEX_PGM_HEADER_FILE
+#define DB_INDEX_PGM_HEADER_FILE
+#pragma once
+
+#include <bit>
+#include <span>
+#include <array>
+#include <limits>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+#include <type_traits>
+#include "time_conversions.h"
+#include "db_concepts.h"
+
+namespace mz {
+	namespace db {
+
+
+		// compressed alternative to db_index_lin for keys that are a single signed 64 bit
+		// Key ordered by its value, like row_id, appended in increasing order.
+		// keys are kept in blocks of BlockKeys: the lower() of the first key and the
+		// offset of every key from it packed in as many bits as the largest one needs,
+		// so a key is decoded at any position without touching its neighbours. timestamps
+		// a few microseconds apart take 16 to 24 bits a key instead of 64.
+		// the blocks are found through a piecewise linear model of block number against
+		// first key, built while appending, which predicts the block within Eps blocks;
+		// a search is one small search over the model, one over 2 * Eps + 3 block starts
+		// and one inside the block. the last keys stay uncompressed until a block fills.
+		// keys are appended at Val == size() only, an erased row is not reused. erase
+		// keeps the key with its flags cleared like db_index_lin, the offset only shrinks
+		// so it is rewritten in place.
+		template <mz::db::KeyType primary_key>
+		class db_index_pgm
+		{
+		public:
+
+			static constexpr bool monotone{ true };
+			static constexpr bool ordered{ true };
+
+			using key_type = primary_key;
+			using value_type = int64_t;
+			using keyval_ref = std::pair<key_type&, value_type&>;
+			using pair_type = std::pair<key_type, value_type>;
+
+			static_assert(sizeof(key_type) == sizeof(int64_t) && std::is_standard_layout_v<key_type>
+				&& requires (key_type k) { { k.Key } -> std::convertible_to<int64_t>; },
+				"db_index_pgm needs keys that are a single signed 64 bit Key");
+
+			static constexpr size_t BlockKeys{ 64 };
+			static constexpr size_t Eps{ 8 };
+
+
+			template <bool Const>
+			class basic_iterator
+			{
+			public:
+
+				using map_pointer = std::conditional_t<Const, db_index_pgm const*, db_index_pgm*>;
+
+				// the key at a position, it->erase() tombstones it in place
+				struct proxy
+				{
+					map_pointer Map;
+					size_t Pos;
+
+					key_type key() const noexcept { return Map->key_at(Pos); }
+					operator key_type () const noexcept { return key(); }
+					bool erased() const noexcept { return key().erased(); }
+					void erase() const noexcept requires (!Const) { Map->tombstone(Pos); }
+					proxy const* operator -> () const noexcept { return this; }
+
+					friend bool operator == (proxy const& L, key_type R) noexcept { return L.key() == R; }
+				};
+
+				using iterator_category = std::random_access_iterator_tag;
+				using value_type = key_type;
+				using difference_type = std::ptrdiff_t;
+				using reference = proxy;
+				using pointer = proxy;
+
+				basic_iterator() noexcept = default;
+				basic_iterator(map_pointer Map, size_t Pos) noexcept : Map{ Map }, Pos{ Pos } {}
+				operator basic_iterator<true>() const noexcept requires (!Const) { return { Map, Pos }; }
+
+				proxy operator * () const noexcept { return proxy{ Map, Pos }; }
+				proxy operator -> () const noexcept { return proxy{ Map, Pos }; }
+				proxy operator [] (difference_type n) const noexcept { return proxy{ Map, size_t(difference_type(Pos) + n) }; }
+
+				basic_iterator& operator ++ () noexcept { ++Pos; return *this; }
+				basic_iterator& operator -- () noexcept { --Pos; return *this; }
+				basic_iterator operator ++ (int) noexcept { auto it = *this; ++Pos; return it; }
+				basic_iterator operator -- (int) noexcept { auto it = *this; --Pos; return it; }
+				basic_iterator& operator += (difference_type n) noexcept { Pos = size_t(difference_type(Pos) + n); return *this; }
+				basic_iterator& operator -= (difference_type n) noexcept { Pos = size_t(difference_type(Pos) - n); return *this; }
+
+				friend basic_iterator operator + (basic_iterator it, difference_type n) noexcept { return it += n; }
+				friend basic_iterator operator + (difference_type n, basic_iterator it) noexcept { return it += n; }
+				friend basic_iterator operator - (basic_iterator it, difference_type n) noexcept { return it -= n; }
+				friend difference_type operator - (basic_iterator L, basic_iterator R) noexcept { return difference_type(L.Pos) - difference_type(R.Pos); }
+
+				friend bool operator == (basic_iterator L, basic_iterator R) noexcept { return L.Pos == R.Pos; }
+				friend auto operator <=> (basic_iterator L, basic_iterator R) noexcept { return L.Pos <=> R.Pos; }
+
+				map_pointer Map{ nullptr };
+				size_t Pos{ 0 };
+			};
+
+			using iterator = basic_iterator<false>;
+			using const_iterator = basic_iterator<true>;
+			using insert_return_type = std::pair<iterator, bool>;
+
+
+			db_index_pgm() noexcept = default;
+
+
+
+			iterator lower_bound(key_type Key) noexcept { return iterator{ this, lower_pos(raw(Key.lower())) }; }
+			iterator upper_bound(key_type Key) noexcept { return lower_bound(Key.next()); }
+
+			iterator find(key_type Key) noexcept
+			{
+				size_t Pos = lower_pos(raw(Key.lower()));
+				if (Pos < size() && Key == key_at(Pos)) {
+					return iterator{ this, Pos };
+				}
+				return end();
+			}
+
+
+			// like db_index_lin, KV.second is tried first as the row of KV.first
+			iterator select(keyval_ref KV)
+			{
+				size_t Index = size_t(KV.second);
+				if (Index < size() && key_at(Index) == KV.first)
+				{
+					KV.first = key_at(Index);
+					return iterator{ this, Index };
+				}
+				auto it = find(KV.first);
+				if (it != end()) {
+					KV.first = key_at(it.Pos);
+					KV.second = static_cast<value_type>(it.Pos);
+				}
+				else {
+					KV.first.erase();
+					KV.second = -1;
+				}
+				return it;
+			}
+
+			iterator select(key_type Key, value_type& Val)
+			{
+				auto it = find(Key);
+				Val = it != end() ? value_type(it.Pos) : -1;
+				return it;
+			}
+
+
+			// appends at Val == size() when Key is greater than the last key
+			insert_return_type insert(key_type Key, value_type Val) noexcept
+			{
+				if (Val == value_type(size()) && LastKey < Key)
+				{
+					push_back(Key);
+					return insert_return_type{ iterator{ this, size_t(Val) }, true };
+				}
+				return insert_return_type{ upper_bound(Key), false };
+			}
+
+			// appends Pairs, which have to continue the rows in order, see db_index_lin
+			bool insert_sorted(std::span<pair_type const> Pairs, bool Validate = true)
+			{
+				if (Validate)
+				{
+					key_type Last = LastKey;
+					size_t Next = size();
+					for (auto& [Key, Val] : Pairs)
+					{
+						if (Val < 0 || size_t(Val) != Next++ || !(Last < Key)) {
+							return true;
+						}
+						Last = Key.upper();
+					}
+				}
+				reserve(size() + Pairs.size());
+				for (auto& KV : Pairs) {
+					push_back(KV.first);
+				}
+				return false;
+			}
+
+			// Func(Key, Val) for every row, erased ones included
+			void for_each(auto&& Func) const
+			{
+				for (size_t b = 0; b < Firsts.size(); ++b)
+				{
+					for (size_t i = 0; i < BlockKeys; ++i) {
+						Func(cooked(Firsts[b] + int64_t(bits(b, i))), value_type(b * BlockKeys + i));
+					}
+				}
+				size_t Base = Firsts.size() * BlockKeys;
+				for (size_t i = 0; i < TailSize; ++i) {
+					Func(cooked(Tail[i]), value_type(Base + i));
+				}
+			}
+
+
+			iterator erase(iterator pos) noexcept
+			{
+				if (pos.Pos + 1 != size())
+				{
+					tombstone(pos.Pos);
+					return ++pos;
+				}
+				pop_back();
+				return end();
+			}
+
+			bool pop(iterator pos) noexcept
+			{
+				if (pos.Pos + 1 != size())
+				{
+					tombstone(pos.Pos);
+					return false;
+				}
+				pop_back();
+				return true;
+			}
+
+			// erases the key at pos and keeps it as a tombstone, also the last one
+			void tombstone(iterator pos) noexcept { tombstone(pos.Pos); }
+
+
+			key_type key_at(size_t Pos) const noexcept
+			{
+				size_t Block = Pos / BlockKeys;
+				if (Block < Firsts.size()) {
+					return cooked(Firsts[Block] + int64_t(bits(Block, Pos % BlockKeys)));
+				}
+				return cooked(Tail[Pos - Firsts.size() * BlockKeys]);
+			}
+
+			// bytes held by the index, for comparing with 8 a key of db_index_lin
+			size_t memory() const noexcept
+			{
+				return Bits.capacity() * sizeof(uint64_t) + Firsts.capacity() * sizeof(int64_t)
+					+ BitPos.capacity() * sizeof(uint64_t) + Widths.capacity()
+					+ Model.capacity() * sizeof(segment) + sizeof(*this);
+			}
+
+
+			key_type LastKey{};
+
+			void clear() noexcept
+			{
+				Bits.clear();
+				Firsts.clear();
+				BitPos.clear();
+				Widths.clear();
+				Model.clear();
+				TailSize = 0;
+				LastKey.clear();
+			}
+
+			void reserve(size_t Count)
+			{
+				size_t Blocks = Count / BlockKeys + 1;
+				Firsts.reserve(Blocks);
+				BitPos.reserve(Blocks);
+				Widths.reserve(Blocks);
+			}
+
+			iterator end() noexcept { return iterator{ this, size() }; }
+			iterator begin() noexcept { return iterator{ this, 0 }; }
+
+			bool empty() const noexcept { return !size(); }
+			size_t size() const noexcept { return Firsts.size() * BlockKeys + TailSize; }
+			const_iterator end() const noexcept { return const_iterator{ this, size() }; }
+			const_iterator begin() const noexcept { return const_iterator{ this, 0 }; }
+
+			const_iterator find(key_type Key) const noexcept { return const_cast<db_index_pgm*>(this)->find(Key); }
+			const_iterator lower_bound(key_type Key) const noexcept { return const_cast<db_index_pgm*>(this)->lower_bound(Key); }
+			const_iterator upper_bound(key_type Key) const noexcept { return const_cast<db_index_pgm*>(this)->upper_bound(Key); }
+			const_iterator select(key_type Key, value_type& Val) const noexcept { return const_cast<db_index_pgm*>(this)->select(Key, Val); }
+
+
+		private:
+
+			// blocks Y.. starting at keys X.. are predicted at Y + Slope * (Key - X),
+			// Slope being any value in [Lo, Hi] keeps every block start within Eps
+			struct segment
+			{
+				int64_t X;
+				size_t Y;
+				double Lo;
+				double Hi;
+
+				double slope() const noexcept { return Hi == std::numeric_limits<double>::max() ? Lo : (Lo + Hi) / 2; }
+			};
+
+			std::vector<uint64_t> Bits;     // offsets of all blocks, packed
+			std::vector<int64_t> Firsts;    // lower() of the first key of each block
+			std::vector<uint64_t> BitPos;   // first bit of each block in Bits
+			std::vector<uint8_t> Widths;    // bits of each offset of a block
+			std::vector<segment> Model;
+			std::array<int64_t, BlockKeys> Tail{};
+			size_t TailSize{ 0 };
+
+
+			static int64_t raw(key_type Key) noexcept { return std::bit_cast<int64_t>(Key); }
+			static key_type cooked(int64_t Raw) noexcept { return std::bit_cast<key_type>(Raw); }
+
+			static constexpr uint64_t mask(size_t Width) noexcept { return Width >= 64 ? ~uint64_t(0) : (uint64_t(1) << Width) - 1; }
+
+			uint64_t bits(size_t Block, size_t i) const noexcept
+			{
+				size_t Width = Widths[Block];
+				uint64_t At = BitPos[Block] + i * Width;
+				size_t Word = size_t(At / 64);
+				size_t Shift = size_t(At % 64);
+				uint64_t Value = Bits[Word] >> Shift;
+				if (Shift + Width > 64) {
+					Value |= Bits[Word + 1] << (64 - Shift);
+				}
+				return Value & mask(Width);
+			}
+
+			void set_bits(size_t Block, size_t i, uint64_t Value) noexcept
+			{
+				size_t Width = Widths[Block];
+				uint64_t At = BitPos[Block] + i * Width;
+				size_t Word = size_t(At / 64);
+				size_t Shift = size_t(At % 64);
+				Bits[Word] = (Bits[Word] & ~(mask(Width) << Shift)) | (Value << Shift);
+				if (Shift + Width > 64) {
+					Bits[Word + 1] = (Bits[Word + 1] & ~(mask(Width) >> (64 - Shift))) | (Value >> (64 - Shift));
+				}
+			}
+
+
+			void push_back(key_type Key)
+			{
+				Tail[TailSize++] = raw(Key);
+				LastKey = Key.upper();
+				if (TailSize == BlockKeys) {
+					seal();
+				}
+			}
+
+			// packs the full tail into a block
+			void seal()
+			{
+				int64_t First = raw(cooked(Tail[0]).lower());
+				size_t Width = std::max<size_t>(std::bit_width(uint64_t(Tail[BlockKeys - 1]) - uint64_t(First)), 1);
+				uint64_t At = BitPos.empty() ? 0 : BitPos.back() + Widths.back() * BlockKeys;
+				Bits.resize(size_t((At + Width * BlockKeys + 63) / 64), 0);
+
+				Firsts.push_back(First);
+				BitPos.push_back(At);
+				Widths.push_back(uint8_t(Width));
+				for (size_t i = 0; i < BlockKeys; ++i) {
+					set_bits(Firsts.size() - 1, i, uint64_t(Tail[i]) - uint64_t(First));
+				}
+				TailSize = 0;
+				fit(First, Firsts.size() - 1);
+			}
+
+			// narrows the slopes of the last segment to keep block Y within Eps, starts a
+			// new segment when no slope does
+			void fit(int64_t X, size_t Y)
+			{
+				if (!Model.empty() && X != Model.back().X)
+				{
+					auto& S = Model.back();
+					double Dx = double(uint64_t(X) - uint64_t(S.X));
+					double Dy = double(Y - S.Y);
+					double Lo = std::max(S.Lo, (Dy - double(Eps)) / Dx);
+					double Hi = std::min(S.Hi, (Dy + double(Eps)) / Dx);
+					if (Lo <= Hi)
+					{
+						S.Lo = Lo;
+						S.Hi = Hi;
+						return;
+					}
+				}
+				Model.push_back(segment{ X, Y, 0.0, std::numeric_limits<double>::max() });
+			}
+
+			// removes the last key, unpacking the last block into the tail when it is empty.
+			// the slopes of its segment stay as narrowed, they hold for the remaining blocks.
+			void pop_back() noexcept
+			{
+				if (!TailSize && !Firsts.empty())
+				{
+					size_t Block = Firsts.size() - 1;
+					for (size_t i = 0; i < BlockKeys; ++i) {
+						Tail[i] = Firsts[Block] + int64_t(bits(Block, i));
+					}
+					TailSize = BlockKeys;
+					Bits.resize(size_t((BitPos[Block] + 63) / 64));
+					if (BitPos[Block] % 64) {
+						Bits.back() &= mask(BitPos[Block] % 64);
+					}
+					Firsts.pop_back();
+					BitPos.pop_back();
+					Widths.pop_back();
+					if (!Model.empty() && Model.back().Y == Block) {
+						Model.pop_back();
+					}
+				}
+				if (!TailSize) {
+					return;
+				}
+				--TailSize;
+				if (!empty()) {
+					LastKey = key_at(size() - 1);
+				}
+				else {
+					LastKey.clear();
+				}
+			}
+
+			void tombstone(size_t Pos) noexcept
+			{
+				size_t Block = Pos / BlockKeys;
+				if (Block < Firsts.size())
+				{
+					key_type Key = cooked(Firsts[Block] + int64_t(bits(Block, Pos % BlockKeys)));
+					Key.erase();
+					set_bits(Block, Pos % BlockKeys, uint64_t(raw(Key)) - uint64_t(Firsts[Block]));
+				}
+				else
+				{
+					key_type Key = cooked(Tail[Pos - Firsts.size() * BlockKeys]);
+					Key.erase();
+					Tail[Pos - Firsts.size() * BlockKeys] = raw(Key);
+				}
+			}
+
+
+			// block holding the last block start not greater than Target, -1 when none is
+			ptrdiff_t block_of(int64_t Target) const noexcept
+			{
+				if (Firsts.empty() || Target < Firsts[0]) {
+					return -1;
+				}
+				auto S = std::upper_bound(Model.begin(), Model.end(), Target, [](int64_t T, segment const& M) noexcept { return T < M.X; }) - 1;
+				size_t Lo = S->Y;
+				size_t Hi = S + 1 != Model.end() ? (S + 1)->Y : Firsts.size();
+
+				double Guess = double(S->Y) + S->slope() * double(uint64_t(Target) - uint64_t(S->X));
+				size_t Pos = Guess <= double(Lo) ? Lo : Guess >= double(Hi) ? Hi - 1 : size_t(Guess);
+				size_t From = Pos > Lo + Eps + 1 ? Pos - Eps - 1 : Lo;
+				size_t To = std::min(Hi, Pos + Eps + 2);
+				if (Firsts[From] > Target || (To < Hi && Firsts[To] <= Target)) {
+					From = Lo;
+					To = Hi;
+				}
+				return std::upper_bound(Firsts.begin() + From, Firsts.begin() + To, Target) - Firsts.begin() - 1;
+			}
+
+			// first position whose key is not less than Target, as std::lower_bound
+			size_t lower_pos(int64_t Target) const noexcept
+			{
+				size_t Base = Firsts.size() * BlockKeys;
+				if (TailSize && raw(cooked(Tail[0]).lower()) <= Target) {
+					return Base + size_t(std::lower_bound(Tail.begin(), Tail.begin() + TailSize, Target) - Tail.begin());
+				}
+
+				ptrdiff_t Block = block_of(Target);
+				if (Block < 0) {
+					return 0;
+				}
+				uint64_t Offset = uint64_t(Target) - uint64_t(Firsts[size_t(Block)]);
+				size_t Lo{ 0 };
+				size_t Hi{ BlockKeys };
+				while (Lo < Hi)
+				{
+					size_t Mid = (Lo + Hi) / 2;
+					if (bits(size_t(Block), Mid) < Offset) {
+						Lo = Mid + 1;
+					}
+					else {
+						Hi = Mid;
+					}
+				}
+				return size_t(Block) * BlockKeys + Lo;
+			}
+
+		};
+
+
+
+
+
+
+
+
+
+	}
+};
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef DB_INDEX_SEARCH_HEADER_FILE
+#define DB_INDEX_SEARCH_HEADER_FILE
+#pragma once
+
+#include <bit>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#if defined(__AVX2__) || defined(__SSE4_2__)
+#include <immintrin.h>
+#endif
+
+namespace mz {
+	namespace db {
+
+
+		// search accelerator for a sorted array of 64 bit keys that only grows at the end.
+		// every Block keys (one cache line) of the array contribute their first key to a
+		// fence level, every Block fences to the next level and so on until a level fits
+		// in one block. a search reads one cache line per level instead of bouncing
+		// through the array like a binary search.
+		// fences are plain copies, keys may change in place as long as their order does not,
+		// so the low flag bits of a row_id may change if the searched key has them cleared.
+		class db_blocked_search
+		{
+		public:
+
+			static constexpr size_t Block{ 8 };
+
+			db_blocked_search() noexcept = default;
+
+
+			bool enabled() const noexcept { return Enabled; }
+
+			void enable(int64_t const* Keys, size_t Count)
+			{
+				Enabled = true;
+				Levels.clear();
+				for (size_t i = 1; i <= Count; ++i) {
+					push_back(Keys, i);
+				}
+			}
+
+			void disable() noexcept
+			{
+				Enabled = false;
+				Levels.clear();
+				Levels.shrink_to_fit();
+			}
+
+
+			// position of the first key not less than Key, same as std::lower_bound
+			size_t lower_bound(int64_t const* Keys, size_t Count, int64_t Key) const noexcept
+			{
+				size_t Node = 0;
+				for (size_t L = Levels.size(); L-- > 0;)
+				{
+					auto& Level = Levels[L];
+					size_t First = Node * Block;
+					size_t Less = count_less(Level.data() + First, std::min(Block, Level.size() - First), Key);
+					Node = First + (Less ? Less - 1 : 0);
+				}
+				size_t First = Node * Block;
+				return First + count_less(Keys + First, std::min(Block, Count - First), Key);
+			}
+
+
+			// Keys[Count - 1] was appended
+			void push_back(int64_t const* Keys, size_t Count)
+			{
+				int64_t const* Below = Keys;
+				for (size_t L = 0; Count > Block && (Count - 1) % Block == 0; ++L)
+				{
+					if (L == Levels.size()) {
+						Levels.push_back({ Below[0] });
+					}
+					Levels[L].push_back(Below[Count - 1]);
+					Below = Levels[L].data();
+					Count = Levels[L].size();
+				}
+			}
+
+			// Keys[Index] was replaced by a key that sorts at the same position
+			void assign(int64_t const* Keys, size_t Index) noexcept
+			{
+				int64_t Key = Keys[Index];
+				for (size_t L = 0; L < Levels.size() && Index % Block == 0; ++L)
+				{
+					Index /= Block;
+					Levels[L][Index] = Key;
+				}
+			}
+
+			// the array was cut back to Count keys
+			void truncate(size_t Count)
+			{
+				for (size_t L = 0; L < Levels.size(); ++L)
+				{
+					if (Count <= Block) {
+						Levels.resize(L);
+						break;
+					}
+					Levels[L].resize((Count + Block - 1) / Block);
+					Count = Levels[L].size();
+				}
+			}
+
+
+			// number of keys in Keys[0, Count) less than Key, Count <= Block
+			static size_t count_less(int64_t const* Keys, size_t Count, int64_t Key) noexcept
+			{
+#if defined(__AVX2__)
+				if (Count == Block)
+				{
+					__m256i Value = _mm256_set1_epi64x(Key);
+					__m256i Lo = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(Keys));
+					__m256i Hi = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(Keys + 4));
+					unsigned Mask = unsigned(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(Value, Lo))))
+						| unsigned(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpgt_epi64(Value, Hi)))) << 4;
+					return size_t(std::popcount(Mask));
+				}
+#elif defined(__SSE4_2__)
+				if (Count == Block)
+				{
+					__m128i Value = _mm_set1_epi64x(Key);
+					unsigned Mask{ 0 };
+					for (size_t i = 0; i < Block; i += 2)
+					{
+						__m128i Pair = _mm_loadu_si128(reinterpret_cast<__m128i const*>(Keys + i));
+						Mask |= unsigned(_mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(Value, Pair)))) << i;
+					}
+					return size_t(std::popcount(Mask));
+				}
+#endif
+				size_t Less{ 0 };
+				for (size_t i = 0; i < Count; ++i) {
+					Less += Keys[i] < Key;
+				}
+				return Less;
+			}
+
+
+			size_t memory() const noexcept
+			{
+				size_t Bytes{ 0 };
+				for (auto& Level : Levels) {
+					Bytes += Level.capacity() * sizeof(int64_t);
+				}
+				return Bytes;
+			}
+
+
+		private:
+
+			std::vector<std::vector<int64_t>> Levels{};
+			bool Enabled{ false };
+
+		};
+
+
+	}
+};
+
+#endif
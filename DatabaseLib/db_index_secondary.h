@@ -0,0 +1,213 @@
+#ifndef DB_INDEX_SECONDARY_HEADER_FILE
+#define DB_INDEX_SECONDARY_HEADER_FILE
+#pragma once
+
+#include <map>
+#include <span>
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+#include <type_traits>
+#include <unordered_map>
+#include "db_concepts.h"
+
+namespace mz {
+	namespace db {
+
+
+		enum class db_index_kind {
+			ordered,
+			hash,
+		};
+
+
+		// secondary index as db_table sees it, keyed by whatever the derived index
+		// extracts from an entry and mapping it to rows. every row is indexed once, the
+		// index remembers the key of each row so a row can be erased by its number.
+		// functions returning bool return true on failure.
+		template <mz::db::EntryType E>
+		class db_secondary_base
+		{
+		public:
+
+			db_secondary_base(std::string const& Name, bool Unique) : Name{ Name }, Unique{ Unique } {}
+			virtual ~db_secondary_base() = default;
+
+			std::string const Name;
+			bool const Unique;
+
+			// true when indexing Entry at Row would break uniqueness
+			virtual bool conflicts(E const& Entry, int64_t Row) const = 0;
+			virtual bool insert(E const& Entry, int64_t Row) = 0;
+			virtual void erase(int64_t Row) = 0;
+			// moves Row to the key of Entry
+			virtual bool update(E const& Entry, int64_t Row) = 0;
+			// renumbers rows after compaction, Remap[Old] is the new row or -1
+			virtual void remap(std::span<int64_t const> Remap) = 0;
+			virtual void clear() = 0;
+			virtual size_t size() const = 0;
+		};
+
+
+
+
+		// Extract(Entry) returns the key by value, std::string rather than std::string_view
+		// for names held in the entry. Kind picks a std::multimap ordered by std::less or a
+		// std::unordered_multimap hashed by Hash.
+		template <mz::db::EntryType E, typename Extract, mz::db::db_index_kind Kind = db_index_kind::ordered, typename Hash = void>
+		class db_secondary : public db_secondary_base<E>
+		{
+		public:
+
+			using entry_type = E;
+			using key_type = std::remove_cvref_t<std::invoke_result_t<Extract const&, E const&>>;
+			using hash_type = std::conditional_t<std::is_void_v<Hash>, std::hash<key_type>, Hash>;
+			using indexer = std::conditional_t<Kind == db_index_kind::ordered,
+				std::multimap<key_type, int64_t>,
+				std::unordered_multimap<key_type, int64_t, hash_type>>;
+			using iterator = typename indexer::const_iterator;
+
+			db_secondary(std::string const& Name, bool Unique, Extract Func) : db_secondary_base<E>{ Name, Unique }, Func{ std::move(Func) } {}
+
+
+			key_type key(E const& Entry) const { return Func(Entry); }
+
+
+			// rows with Key, found in memory only
+			std::pair<iterator, iterator> equal_range(key_type const& Key) const { return Index.equal_range(Key); }
+
+			size_t count(key_type const& Key) const { return Index.count(Key); }
+
+			// first row with Key, -1 when there is none
+			int64_t find(key_type const& Key) const
+			{
+				auto it = Index.find(Key);
+				return it != Index.end() ? it->second : -1;
+			}
+
+			std::vector<int64_t> rows(key_type const& Key) const
+			{
+				std::vector<int64_t> Rows;
+				for (auto [it, last] = Index.equal_range(Key); it != last; ++it) {
+					Rows.push_back(it->second);
+				}
+				return Rows;
+			}
+
+			// key indexed for Row, nullptr when Row is not indexed
+			key_type const* key_of(int64_t Row) const
+			{
+				auto it = ByRow.find(Row);
+				return it != ByRow.end() ? &it->second : nullptr;
+			}
+
+			iterator begin() const noexcept { return Index.begin(); }
+			iterator end() const noexcept { return Index.end(); }
+
+
+
+			bool conflicts(E const& Entry, int64_t Row) const override
+			{
+				if (!this->Unique) {
+					return false;
+				}
+				int64_t Other = find(Func(Entry));
+				return Other >= 0 && Other != Row;
+			}
+
+			bool insert(E const& Entry, int64_t Row) override
+			{
+				if (ByRow.contains(Row) || conflicts(Entry, Row)) {
+					return true;
+				}
+				key_type Key = Func(Entry);
+				Index.emplace(Key, Row);
+				ByRow.emplace(Row, std::move(Key));
+				return false;
+			}
+
+			void erase(int64_t Row) override
+			{
+				auto it = ByRow.find(Row);
+				if (it == ByRow.end()) {
+					return;
+				}
+				unlink(it->second, Row);
+				ByRow.erase(it);
+			}
+
+			bool update(E const& Entry, int64_t Row) override
+			{
+				if (conflicts(Entry, Row)) {
+					return true;
+				}
+				key_type Key = Func(Entry);
+				auto it = ByRow.find(Row);
+				if (it != ByRow.end())
+				{
+					if (it->second == Key) {
+						return false;
+					}
+					unlink(it->second, Row);
+					it->second = Key;
+				}
+				else {
+					ByRow.emplace(Row, Key);
+				}
+				Index.emplace(std::move(Key), Row);
+				return false;
+			}
+
+			void remap(std::span<int64_t const> Remap) override
+			{
+				indexer Moved;
+				std::unordered_map<int64_t, key_type> MovedRows;
+				for (auto& [Row, Key] : ByRow)
+				{
+					int64_t To = size_t(Row) < Remap.size() ? Remap[size_t(Row)] : -1;
+					if (To >= 0)
+					{
+						Moved.emplace(Key, To);
+						MovedRows.emplace(To, Key);
+					}
+				}
+				Index.swap(Moved);
+				ByRow.swap(MovedRows);
+			}
+
+			void clear() override
+			{
+				Index.clear();
+				ByRow.clear();
+			}
+
+			size_t size() const override { return Index.size(); }
+
+
+
+		protected:
+
+			Extract Func;
+			indexer Index;
+			std::unordered_map<int64_t, key_type> ByRow;
+
+			void unlink(key_type const& Key, int64_t Row)
+			{
+				for (auto [it, last] = Index.equal_range(Key); it != last; ++it)
+				{
+					if (it->second == Row) {
+						Index.erase(it);
+						return;
+					}
+				}
+			}
+
+		};
+
+
+
+	}
+};
+
+#endif
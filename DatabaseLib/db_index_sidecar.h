@@ -0,0 +1,231 @@
+#ifndef DB_INDEX_SIDECAR_HEADER_FILE
+#define DB_INDEX_SIDECAR_HEADER_FILE
+#pragma once
+
+#include <span>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+#include "db_file_io.h"
+
+namespace mz {
+    namespace db {
+
+
+        // order independent of how the bytes are split, as long as every part but the
+        // last is a multiple of 8 bytes long.
+        inline uint64_t db_checksum(void const* Data, size_t Size, uint64_t Hash = 0x9E3779B97F4A7C15ull) noexcept
+        {
+            auto Bytes = static_cast<unsigned char const*>(Data);
+            for (size_t i = 0; i < Size; i += sizeof(uint64_t))
+            {
+                uint64_t Word{ 0 };
+                std::memcpy(&Word, Bytes + i, std::min(sizeof(uint64_t), Size - i));
+                Hash = (Hash ^ Word) * 0x100000001B3ull;
+                Hash ^= Hash >> 29;
+            }
+            return Hash;
+        }
+
+
+
+
+        // primary index of a table saved next to its data file as <data>.idx:
+        // header, the (key, row) pairs in index order, the free rows and a trailer
+        // repeating the generation. a sidecar is written to <data>.idx.tmp, synced and
+        // renamed over the old one, so a crash leaves either the old or the new file.
+        // I/O functions return true on failure.
+        class db_index_sidecar
+        {
+        public:
+
+            static constexpr uint64_t Magic{ 0x3158444943445A4Dull };   // "MZDCIDX1"
+            static constexpr uint32_t Version{ 1 };
+            static constexpr size_t Chunk{ 4096 };
+
+            struct header
+            {
+                uint64_t Magic{ db_index_sidecar::Magic };
+                uint32_t Version{ db_index_sidecar::Version };
+                uint32_t RecordSize{ 0 };
+                uint64_t Generation{ 0 };
+                int64_t Rows{ 0 };          // data rows the index covers
+                int64_t FileSize{ 0 };      // bytes of the data file holding them
+                uint64_t LastRow{ 0 };      // checksum of the key of row Rows - 1
+                uint64_t Pairs{ 0 };
+                uint64_t Free{ 0 };
+            };
+
+            struct trailer
+            {
+                uint64_t Generation{ 0 };
+                uint64_t Checksum{ 0 };     // of pairs and free rows
+                uint64_t Magic{ db_index_sidecar::Magic };
+            };
+
+            template <typename K>
+            struct record
+            {
+                K Key;
+                int64_t Val;
+            };
+
+
+            static std::filesystem::path path_of(std::filesystem::path const& Data)
+            {
+                auto Path = Data;
+                Path += ".idx";
+                return Path;
+            }
+
+
+            // rows covered by the sidecar at Path, -1 when there is none or its header is unreadable
+            static int64_t rows(std::filesystem::path const& Path) noexcept
+            {
+                std::error_code Error;
+                if (!std::filesystem::exists(Path, Error)) {
+                    return -1;
+                }
+                db_native_file File;
+                header Header{};
+                if (!File.create(Path) || File.read_at(&Header, sizeof(Header), 0) || Header.Magic != Magic) {
+                    return -1;
+                }
+                return Header.Rows;
+            }
+
+
+            static void remove(std::filesystem::path const& Path) noexcept
+            {
+                std::error_code Error;
+                std::filesystem::remove(Path, Error);
+            }
+
+
+            // Keys.for_each(Key, Val) supplies the pairs
+            template <typename map_type>
+            static bool write(std::filesystem::path const& Path, map_type const& Keys, std::span<int64_t const> Free, header Header)
+            {
+                using record_type = record<typename map_type::key_type>;
+
+                auto Temp = Path;
+                Temp += ".tmp";
+                db_native_file File;
+                if (!File.create(Temp) || File.resize(0)) {
+                    return true;
+                }
+
+                Header.RecordSize = uint32_t(sizeof(record_type));
+                Header.Pairs = Keys.size();
+                Header.Free = Free.size();
+
+                int64_t Offset = sizeof(header);
+                uint64_t Checksum = db_checksum(nullptr, 0);
+                bool Failed{ false };
+                std::vector<record_type> Buffer;
+                Buffer.reserve(Chunk);
+                auto Drain = [&]
+                    {
+                        size_t Bytes = Buffer.size() * sizeof(record_type);
+                        Failed = Failed || File.write_at(Buffer.data(), Bytes, Offset);
+                        Checksum = db_checksum(Buffer.data(), Bytes, Checksum);
+                        Offset += int64_t(Bytes);
+                        Buffer.clear();
+                    };
+
+                uint64_t Written{ 0 };
+                Keys.for_each([&](auto const& Key, int64_t Val)
+                    {
+                        record_type Record{};
+                        Record.Key = Key;
+                        Record.Val = Val;
+                        Buffer.push_back(Record);
+                        ++Written;
+                        if (Buffer.size() == Chunk) {
+                            Drain();
+                        }
+                    });
+                Drain();
+
+                size_t FreeBytes = Free.size() * sizeof(int64_t);
+                Failed = Failed || Written != Header.Pairs || File.write_at(Free.data(), FreeBytes, Offset);
+                Checksum = db_checksum(Free.data(), FreeBytes, Checksum);
+                Offset += int64_t(FreeBytes);
+
+                trailer Trailer{ Header.Generation, Checksum };
+                if (Failed || File.write_at(&Trailer, sizeof(Trailer), Offset) || File.write_at(&Header, sizeof(Header), 0) || File.sync())
+                {
+                    File.close();
+                    remove(Temp);
+                    return true;
+                }
+                File.close();
+
+                std::error_code Error;
+                std::filesystem::rename(Temp, Path, Error);
+                if (Error) {
+                    remove(Temp);
+                    return true;
+                }
+                return false;
+            }
+
+
+            // reads a complete sidecar written for keys of type K, fails on any mismatch
+            template <typename K>
+            static bool read(std::filesystem::path const& Path, std::vector<std::pair<K, int64_t>>& Pairs, std::vector<int64_t>& Free, header& Header)
+            {
+                using record_type = record<K>;
+
+                std::error_code Error;
+                if (!std::filesystem::exists(Path, Error)) {
+                    return true;
+                }
+                db_native_file File;
+                if (!File.create(Path) || File.read_at(&Header, sizeof(Header), 0)) {
+                    return true;
+                }
+                if (Header.Magic != Magic || Header.Version != Version || Header.RecordSize != sizeof(record_type)) {
+                    return true;
+                }
+                int64_t Expected = int64_t(sizeof(header) + Header.Pairs * sizeof(record_type) + Header.Free * sizeof(int64_t) + sizeof(trailer));
+                if (File.size() != Expected) {
+                    return true;
+                }
+
+                std::vector<record_type> Records(Header.Pairs);
+                Free.resize(Header.Free);
+                int64_t Offset = sizeof(header);
+                trailer Trailer{};
+                if (File.read_at(Records.data(), Records.size() * sizeof(record_type), Offset)
+                    || File.read_at(Free.data(), Free.size() * sizeof(int64_t), Offset + int64_t(Records.size() * sizeof(record_type)))
+                    || File.read_at(&Trailer, sizeof(Trailer), Expected - int64_t(sizeof(trailer))))
+                {
+                    return true;
+                }
+
+                uint64_t Checksum = db_checksum(Records.data(), Records.size() * sizeof(record_type));
+                Checksum = db_checksum(Free.data(), Free.size() * sizeof(int64_t), Checksum);
+                if (Trailer.Magic != Magic || Trailer.Generation != Header.Generation || Trailer.Checksum != Checksum) {
+                    return true;
+                }
+
+                Pairs.resize(Records.size());
+                for (size_t i = 0; i < Records.size(); ++i) {
+                    Pairs[i] = { Records[i].Key, Records[i].Val };
+                }
+                return false;
+            }
+
+        };
+
+
+
+    }
+};
+
+#endif
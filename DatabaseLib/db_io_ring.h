@@ -0,0 +1,480 @@
+#ifndef DB_IO_RING_HEADER_FILE
+#define DB_IO_RING_HEADER_FILE
+#pragma once
+
+#include <deque>
+#include <cerrno>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <functional>
+#include "db_file_io.h"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define DB_IO_URING 1
+#include <cstring>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#else
+#define DB_IO_URING 0
+#endif
+
+
+namespace mz {
+    namespace db {
+
+
+        // queue of positional reads, writes and syncs on db_native_file handles, submitted to
+        // the kernel together through io_uring where it is available and performed
+        // synchronously by submit() otherwise. Done(Result) runs from wait() or poll() on the
+        // thread owning the ring, with the bytes transferred or -errno; short transfers are
+        // continued, so success always reports the full size. buffers must stay alive until
+        // their operation completes. not synchronized, use one ring per thread.
+        class db_io_ring
+        {
+        public:
+
+            using completion = std::function<void(int64_t Result)>;
+
+            // Entries is rounded up to a power of 2 by the kernel, 0 keeps the synchronous path
+            explicit db_io_ring(unsigned Entries = 256) noexcept
+            {
+#if DB_IO_URING
+                if (Entries) {
+                    setup(Entries);
+                }
+#endif
+            }
+
+            db_io_ring(db_io_ring const&) = delete;
+            db_io_ring& operator = (db_io_ring const&) = delete;
+
+            ~db_io_ring()
+            {
+                wait_all();
+#if DB_IO_URING
+                teardown();
+#endif
+            }
+
+
+            // true when operations go through io_uring
+            bool native() const noexcept
+            {
+#if DB_IO_URING
+                return Ring >= 0;
+#else
+                return false;
+#endif
+            }
+
+            // operations queued, in flight or completed but not yet reported
+            size_t pending() const noexcept { return Ops.size() - FreeOps.size() + Ready.size(); }
+
+
+            void read(db_native_file const& File, void* Data, size_t Size, int64_t Offset, completion Done)
+            {
+                queue(op{ op_kind::read, &File, static_cast<char*>(Data), Size, Offset, std::move(Done) });
+            }
+
+            void write(db_native_file const& File, void const* Data, size_t Size, int64_t Offset, completion Done)
+            {
+                queue(op{ op_kind::write, &File, const_cast<char*>(static_cast<char const*>(Data)), Size, Offset, std::move(Done) });
+            }
+
+            void datasync(db_native_file& File, completion Done)
+            {
+                queue(op{ op_kind::datasync, &File, nullptr, 0, 0, std::move(Done) });
+            }
+
+            // reports Result through Done on the next wait() or poll() without any I/O
+            void post(completion Done, int64_t Result = 0)
+            {
+                Ready.emplace_back(std::move(Done), Result);
+            }
+
+
+            // hands every queued operation to the kernel, returns true on failure
+            bool submit() noexcept
+            {
+#if DB_IO_URING
+                if (native()) {
+                    return enter(0);
+                }
+#endif
+                for (uint32_t Slot : Queued) {
+                    perform(Slot);
+                }
+                Queued.clear();
+                return false;
+            }
+
+            // submits and reports completions until at least Min operations were reported or
+            // none is left, returns the number reported.
+            size_t wait(size_t Min = 1)
+            {
+                size_t Done = report();
+                while (Done < Min && pending())
+                {
+#if DB_IO_URING
+                    if (native())
+                    {
+                        if (enter(1)) {
+                            break;
+                        }
+                        reap();
+                    }
+                    else
+#endif
+                    {
+                        submit();
+                    }
+                    Done += report();
+                }
+                return Done;
+            }
+
+            // waits until nothing is left, including operations queued by completions
+            size_t wait_all()
+            {
+                size_t Done{ 0 };
+                while (pending())
+                {
+                    size_t Reported = wait(pending());
+                    if (!Reported) {
+                        break;
+                    }
+                    Done += Reported;
+                }
+                return Done;
+            }
+
+            // submits and reports the operations completed so far without blocking
+            size_t poll()
+            {
+#if DB_IO_URING
+                if (native() && !enter(0)) {
+                    reap();
+                }
+#endif
+                if (!native()) {
+                    submit();
+                }
+                return report();
+            }
+
+
+
+        private:
+
+            enum class op_kind : uint8_t {
+                read,
+                write,
+                datasync,
+            };
+
+            struct op
+            {
+                op_kind Kind{ op_kind::read };
+                db_native_file const* File{ nullptr };
+                char* Data{ nullptr };
+                size_t Size{ 0 };
+                int64_t Offset{ 0 };
+                completion Done{};
+                size_t Moved{ 0 };      // bytes transferred so far
+            };
+
+            std::vector<op> Ops;
+            std::vector<uint32_t> FreeOps;
+            std::vector<uint32_t> Queued;   // waiting for submit() without io_uring
+            std::deque<std::pair<completion, int64_t>> Ready;
+
+
+            void queue(op&& Op)
+            {
+                uint32_t Slot;
+                if (!FreeOps.empty()) {
+                    Slot = FreeOps.back();
+                    FreeOps.pop_back();
+                    Ops[Slot] = std::move(Op);
+                }
+                else {
+                    Slot = uint32_t(Ops.size());
+                    Ops.push_back(std::move(Op));
+                }
+#if DB_IO_URING
+                if (native()) {
+                    push(Slot);
+                    return;
+                }
+#endif
+                Queued.push_back(Slot);
+            }
+
+            void finish(uint32_t Slot, int64_t Result)
+            {
+                Ready.emplace_back(std::move(Ops[Slot].Done), Result);
+                Ops[Slot].Done = nullptr;
+                FreeOps.push_back(Slot);
+            }
+
+            size_t report()
+            {
+                size_t Done{ 0 };
+                while (!Ready.empty())
+                {
+                    auto [Func, Result] = std::move(Ready.front());
+                    Ready.pop_front();
+                    if (Func) {
+                        Func(Result);
+                    }
+                    ++Done;
+                }
+                return Done;
+            }
+
+            // synchronous path, also taken by every operation without io_uring
+            void perform(uint32_t Slot)
+            {
+                auto& Op = Ops[Slot];
+                bool Failed{ false };
+                switch (Op.Kind)
+                {
+                case op_kind::read: Failed = Op.File->read_at(Op.Data + Op.Moved, Op.Size - Op.Moved, Op.Offset + int64_t(Op.Moved)); break;
+                case op_kind::write: Failed = Op.File->write_at(Op.Data + Op.Moved, Op.Size - Op.Moved, Op.Offset + int64_t(Op.Moved)); break;
+                case op_kind::datasync: Failed = const_cast<db_native_file*>(Op.File)->datasync(); break;
+                }
+                finish(Slot, Failed ? -int64_t(EIO) : int64_t(Op.Size));
+            }
+
+
+
+#if DB_IO_URING
+
+            int Ring{ -1 };
+            unsigned SqEntries{ 0 };
+            unsigned CqEntries{ 0 };
+            void* SqMap{ nullptr };
+            size_t SqMapSize{ 0 };
+            void* CqMap{ nullptr };
+            size_t CqMapSize{ 0 };
+            io_uring_sqe* Sqes{ nullptr };
+            size_t SqesSize{ 0 };
+
+            unsigned* SqHead{ nullptr };
+            unsigned* SqTail{ nullptr };
+            unsigned SqMask{ 0 };
+            unsigned* SqArray{ nullptr };
+            unsigned* CqHead{ nullptr };
+            unsigned* CqTail{ nullptr };
+            unsigned CqMask{ 0 };
+            io_uring_cqe* Cqes{ nullptr };
+
+            unsigned Unsubmitted{ 0 };      // sqes written since the last io_uring_enter
+            size_t InFlight{ 0 };           // sqes handed out and not yet reaped
+
+
+            static unsigned load_acquire(unsigned* Word) noexcept { return std::atomic_ref<unsigned>(*Word).load(std::memory_order_acquire); }
+            static void store_release(unsigned* Word, unsigned Value) noexcept { std::atomic_ref<unsigned>(*Word).store(Value, std::memory_order_release); }
+
+
+            // leaves Ring at -1 when the kernel has no io_uring, forbids it or lacks IORING_OP_READ
+            void setup(unsigned Entries) noexcept
+            {
+                io_uring_params Params;
+                std::memset(&Params, 0, sizeof(Params));
+                int Fd = int(::syscall(__NR_io_uring_setup, Entries, &Params));
+                if (Fd < 0) {
+                    return;
+                }
+                // IORING_FEAT_RW_CUR_POS came with IORING_OP_READ and IORING_OP_WRITE in 5.6
+                if (!(Params.features & IORING_FEAT_RW_CUR_POS)) {
+                    ::close(Fd);
+                    return;
+                }
+
+                SqMapSize = Params.sq_off.array + Params.sq_entries * sizeof(unsigned);
+                CqMapSize = Params.cq_off.cqes + Params.cq_entries * sizeof(io_uring_cqe);
+                bool Single = Params.features & IORING_FEAT_SINGLE_MMAP;
+                if (Single) {
+                    SqMapSize = CqMapSize = std::max(SqMapSize, CqMapSize);
+                }
+
+                SqMap = ::mmap(nullptr, SqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Fd, IORING_OFF_SQ_RING);
+                if (SqMap == MAP_FAILED) {
+                    SqMap = nullptr;
+                    ::close(Fd);
+                    return;
+                }
+                CqMap = Single ? SqMap : ::mmap(nullptr, CqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Fd, IORING_OFF_CQ_RING);
+                SqesSize = Params.sq_entries * sizeof(io_uring_sqe);
+                void* SqeMap = CqMap == MAP_FAILED ? MAP_FAILED : ::mmap(nullptr, SqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Fd, IORING_OFF_SQES);
+                if (SqeMap == MAP_FAILED)
+                {
+                    if (CqMap != MAP_FAILED && CqMap != SqMap) {
+                        ::munmap(CqMap, CqMapSize);
+                    }
+                    ::munmap(SqMap, SqMapSize);
+                    SqMap = CqMap = nullptr;
+                    ::close(Fd);
+                    return;
+                }
+                Sqes = static_cast<io_uring_sqe*>(SqeMap);
+
+                auto Sq = static_cast<char*>(SqMap);
+                SqHead = reinterpret_cast<unsigned*>(Sq + Params.sq_off.head);
+                SqTail = reinterpret_cast<unsigned*>(Sq + Params.sq_off.tail);
+                SqMask = *reinterpret_cast<unsigned*>(Sq + Params.sq_off.ring_mask);
+                SqArray = reinterpret_cast<unsigned*>(Sq + Params.sq_off.array);
+                auto Cq = static_cast<char*>(CqMap);
+                CqHead = reinterpret_cast<unsigned*>(Cq + Params.cq_off.head);
+                CqTail = reinterpret_cast<unsigned*>(Cq + Params.cq_off.tail);
+                CqMask = *reinterpret_cast<unsigned*>(Cq + Params.cq_off.ring_mask);
+                Cqes = reinterpret_cast<io_uring_cqe*>(Cq + Params.cq_off.cqes);
+
+                SqEntries = Params.sq_entries;
+                CqEntries = Params.cq_entries;
+                Ring = Fd;
+            }
+
+            void teardown() noexcept
+            {
+                if (Ring < 0) {
+                    return;
+                }
+                ::munmap(Sqes, SqesSize);
+                if (CqMap != SqMap) {
+                    ::munmap(CqMap, CqMapSize);
+                }
+                ::munmap(SqMap, SqMapSize);
+                ::close(Ring);
+                Ring = -1;
+            }
+
+            // writes the sqe for Slot, making room first when the rings are full
+            void push(uint32_t Slot)
+            {
+                // completions past CqEntries could overflow the completion ring
+                while (InFlight >= CqEntries || *SqTail - load_acquire(SqHead) >= SqEntries)
+                {
+                    if (enter(InFlight >= CqEntries ? 1 : 0))
+                    {
+                        // the ring is unusable, finish the operation synchronously
+                        perform(Slot);
+                        return;
+                    }
+                    reap();
+                }
+
+                auto& Op = Ops[Slot];
+                unsigned Tail = *SqTail;
+                unsigned At = Tail & SqMask;
+                io_uring_sqe& Sqe = Sqes[At];
+                std::memset(&Sqe, 0, sizeof(Sqe));
+                Sqe.fd = Op.File->handle();
+                Sqe.user_data = Slot;
+                switch (Op.Kind)
+                {
+                case op_kind::read:
+                case op_kind::write:
+                    Sqe.opcode = Op.Kind == op_kind::read ? IORING_OP_READ : IORING_OP_WRITE;
+                    Sqe.addr = uint64_t(uintptr_t(Op.Data + Op.Moved));
+                    Sqe.len = unsigned(std::min<size_t>(Op.Size - Op.Moved, 1u << 30));
+                    Sqe.off = uint64_t(Op.Offset + int64_t(Op.Moved));
+                    break;
+                case op_kind::datasync:
+                    Sqe.opcode = IORING_OP_FSYNC;
+                    Sqe.fsync_flags = IORING_FSYNC_DATASYNC;
+                    break;
+                }
+                SqArray[At] = At;
+                store_release(SqTail, Tail + 1);
+                ++Unsubmitted;
+                ++InFlight;
+            }
+
+            // io_uring_enter for the unsubmitted sqes, waiting for MinComplete completions,
+            // true when the ring failed
+            bool enter(unsigned MinComplete) noexcept
+            {
+                for (;;)
+                {
+                    if (!Unsubmitted && (!MinComplete || !InFlight)) {
+                        return false;
+                    }
+                    unsigned Flags = MinComplete ? IORING_ENTER_GETEVENTS : 0;
+                    long Res = ::syscall(__NR_io_uring_enter, Ring, Unsubmitted, MinComplete, Flags, nullptr, 0);
+                    if (Res < 0)
+                    {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+                        if ((errno == EAGAIN || errno == EBUSY) && InFlight > Unsubmitted) {
+                            reap();
+                            MinComplete = 0;
+                            continue;
+                        }
+                        return true;
+                    }
+                    Unsubmitted -= unsigned(Res);
+                    if (!Unsubmitted || MinComplete) {
+                        return false;
+                    }
+                }
+            }
+
+            // moves completions to Ready, requeues the rest of short transfers
+            void reap()
+            {
+                unsigned Head = *CqHead;
+                unsigned Tail = load_acquire(CqTail);
+                std::vector<uint32_t> Again;
+                for (; Head != Tail; ++Head)
+                {
+                    io_uring_cqe const& Cqe = Cqes[Head & CqMask];
+                    uint32_t Slot = uint32_t(Cqe.user_data);
+                    int64_t Result = Cqe.res;
+                    --InFlight;
+
+                    auto& Op = Ops[Slot];
+                    if (Op.Kind == op_kind::datasync) {
+                        finish(Slot, Result < 0 ? Result : 0);
+                        continue;
+                    }
+                    if (Result == -EINTR || Result == -EAGAIN) {
+                        Again.push_back(Slot);
+                        continue;
+                    }
+                    if (Result <= 0) {
+                        finish(Slot, Result < 0 ? Result : -int64_t(EIO));
+                        continue;
+                    }
+                    Op.Moved += size_t(Result);
+                    if (Op.Moved < Op.Size) {
+                        Again.push_back(Slot);
+                    }
+                    else {
+                        finish(Slot, int64_t(Op.Size));
+                    }
+                }
+                store_release(CqHead, Head);
+                for (uint32_t Slot : Again) {
+                    push(Slot);
+                }
+            }
+
+#endif
+
+        };
+
+
+
+    }
+};
+
+
+#endif
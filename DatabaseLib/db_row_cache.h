@@ -0,0 +1,158 @@
+#ifndef DB_ROW_CACHE_HEADER_FILE
+#define DB_ROW_CACHE_HEADER_FILE
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include "db_concepts.h"
+
+namespace mz {
+	namespace db {
+
+
+		// copies of up to Capacity rows keyed by row index, evicted by CLOCK: a hit sets the
+		// referenced bit of a row, the hand clears bits until it finds a row without one.
+		// rows enter unreferenced, so a row read once by a scan leaves before a hot one.
+		// not synchronized, it belongs to the table using it.
+		template <mz::db::EntryType E>
+		class db_row_cache
+		{
+		public:
+
+			db_row_cache() noexcept = default;
+
+
+			// drops every row, Rows == 0 turns the cache off
+			void resize(size_t Rows)
+			{
+				clear();
+				Capacity = Rows;
+				Slots.reserve(Rows);
+				Where.reserve(Rows);
+			}
+
+			bool enabled() const noexcept { return Capacity != 0; }
+			size_t capacity() const noexcept { return Capacity; }
+			size_t size() const noexcept { return Where.size(); }
+
+			uint64_t hits() const noexcept { return Hits; }
+			uint64_t misses() const noexcept { return Misses; }
+			uint64_t evictions() const noexcept { return Evictions; }
+
+
+			// cached copy of Row, nullptr on a miss
+			E const* find(int64_t Row) noexcept
+			{
+				if (!Capacity) {
+					return nullptr;
+				}
+				auto it = Where.find(Row);
+				if (it == Where.end()) {
+					++Misses;
+					return nullptr;
+				}
+				++Hits;
+				auto& Slot = Slots[it->second];
+				Slot.Referenced = true;
+				return &Slot.Entry;
+			}
+
+			// caches Row, evicting the next unreferenced row when full
+			void put(int64_t Row, E const& Entry)
+			{
+				if (!Capacity) {
+					return;
+				}
+				if (auto it = Where.find(Row); it != Where.end()) {
+					Slots[it->second].Entry = Entry;
+					return;
+				}
+
+				size_t At;
+				if (!Free.empty()) {
+					At = Free.back();
+					Free.pop_back();
+				}
+				else if (Slots.size() < Capacity) {
+					At = Slots.size();
+					Slots.emplace_back();
+				}
+				else {
+					At = evict();
+				}
+				Slots[At] = slot{ Row, false, Entry };
+				Where.emplace(Row, At);
+			}
+
+			// updates Row when it is cached, write through for db_table::update
+			void assign(int64_t Row, E const& Entry) noexcept
+			{
+				if (auto it = Where.find(Row); it != Where.end()) {
+					Slots[it->second].Entry = Entry;
+				}
+			}
+
+			void erase(int64_t Row) noexcept
+			{
+				if (auto it = Where.find(Row); it != Where.end())
+				{
+					Slots[it->second].Row = -1;
+					Slots[it->second].Referenced = false;
+					Free.push_back(it->second);
+					Where.erase(it);
+				}
+			}
+
+			void clear() noexcept
+			{
+				Slots.clear();
+				Where.clear();
+				Free.clear();
+				Hand = 0;
+			}
+
+
+
+		protected:
+
+			struct slot
+			{
+				int64_t Row{ -1 };
+				bool Referenced{ false };
+				E Entry{};
+			};
+
+			size_t evict() noexcept
+			{
+				for (;; Hand = (Hand + 1) % Slots.size())
+				{
+					auto& Slot = Slots[Hand];
+					if (Slot.Referenced) {
+						Slot.Referenced = false;
+						continue;
+					}
+					size_t At = Hand;
+					Hand = (Hand + 1) % Slots.size();
+					Where.erase(Slot.Row);
+					++Evictions;
+					return At;
+				}
+			}
+
+			std::vector<slot> Slots;
+			std::unordered_map<int64_t, size_t> Where;
+			std::vector<size_t> Free;
+			size_t Capacity{ 0 };
+			size_t Hand{ 0 };
+			uint64_t Hits{ 0 };
+			uint64_t Misses{ 0 };
+			uint64_t Evictions{ 0 };
+
+		};
+
+
+	}
+};
+
+#endif
@@ -0,0 +1,225 @@
+#ifndef DB_SCAN_HEADER_FILE
+#define DB_SCAN_HEADER_FILE
+#pragma once
+
+#include <bit>
+#include <span>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+#include "db_concepts.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace mz {
+	namespace db {
+
+
+		enum class db_compare {
+			eq,
+			ne,
+			lt,
+			le,
+			gt,
+			ge,
+		};
+
+
+		// Field Op Value on one field of the entry. match() tests a block of entries at once,
+		// with AVX2 gathers for 64 and 32 bit integers and doubles when the target has them.
+		template <mz::db::EntryType E, typename F>
+			requires (std::is_arithmetic_v<F>)
+		struct db_field_compare
+		{
+			F E::* Field;
+			db_compare Op;
+			F Value;
+
+			bool operator () (E const& Entry) const noexcept { return test(Entry.*Field); }
+
+			// sets bit i % 64 of Mask[i / 64] when Rows[i] matches, Mask holds (size + 63) / 64 words
+			void match(std::span<E const> Rows, uint64_t* Mask) const noexcept
+			{
+				if (Rows.empty()) {
+					return;
+				}
+				std::memset(Mask, 0, (Rows.size() + 63) / 64 * sizeof(uint64_t));
+
+				size_t i{ 0 };
+#if defined(__AVX2__)
+				i = match_avx2(Rows, Mask);
+#endif
+				// fields are copied out first so the compare loop has no stride and vectorizes
+				constexpr size_t Batch{ 64 };
+				F Values[Batch];
+				auto Base = reinterpret_cast<unsigned char const*>(Rows.data()) + offset(Rows);
+				for (; i < Rows.size(); i += Batch)
+				{
+					size_t Count = std::min(Batch, Rows.size() - i);
+					for (size_t j = 0; j < Count; ++j) {
+						std::memcpy(&Values[j], Base + (i + j) * sizeof(E), sizeof(F));
+					}
+					uint64_t Bits{ 0 };
+					for (size_t j = 0; j < Count; ++j) {
+						Bits |= uint64_t(test(Values[j])) << j;
+					}
+					// i is a multiple of 64 unless the AVX2 loop stopped mid word
+					Mask[i / 64] |= Bits << (i % 64);
+					if (i % 64 && Count > 64 - i % 64) {
+						Mask[i / 64 + 1] |= Bits >> (64 - i % 64);
+					}
+				}
+			}
+
+		private:
+
+			bool test(F Field) const noexcept
+			{
+				switch (Op)
+				{
+				case db_compare::eq: return Field == Value;
+				case db_compare::ne: return Field != Value;
+				case db_compare::lt: return Field < Value;
+				case db_compare::le: return Field <= Value;
+				case db_compare::gt: return Field > Value;
+				case db_compare::ge: return Field >= Value;
+				}
+				return false;
+			}
+
+			size_t offset(std::span<E const> Rows) const noexcept
+			{
+				return size_t(reinterpret_cast<unsigned char const*>(&(Rows[0].*Field)) - reinterpret_cast<unsigned char const*>(Rows.data()));
+			}
+
+#if defined(__AVX2__)
+			// rows done, a multiple of 4 or 8
+			size_t match_avx2(std::span<E const> Rows, uint64_t* Mask) const noexcept
+			{
+				auto Base = reinterpret_cast<char const*>(Rows.data()) + offset(Rows);
+				size_t Done{ 0 };
+
+				if constexpr (std::is_integral_v<F> && std::is_signed_v<F> && sizeof(F) == 8)
+				{
+					__m256i const Value4 = _mm256_set1_epi64x(int64_t(Value));
+					__m256i Offsets = _mm256_set_epi64x(3 * int64_t(sizeof(E)), 2 * int64_t(sizeof(E)), int64_t(sizeof(E)), 0);
+					__m256i const Step = _mm256_set1_epi64x(4 * int64_t(sizeof(E)));
+					for (; Done + 4 <= Rows.size(); Done += 4, Offsets = _mm256_add_epi64(Offsets, Step))
+					{
+						__m256i Fields = _mm256_i64gather_epi64(reinterpret_cast<long long const*>(Base), Offsets, 1);
+						__m256i Hit;
+						switch (Op)
+						{
+						case db_compare::eq: case db_compare::ne: Hit = _mm256_cmpeq_epi64(Fields, Value4); break;
+						case db_compare::lt: case db_compare::ge: Hit = _mm256_cmpgt_epi64(Value4, Fields); break;
+						default: Hit = _mm256_cmpgt_epi64(Fields, Value4); break;
+						}
+						uint64_t Bits = uint64_t(_mm256_movemask_pd(_mm256_castsi256_pd(Hit)));
+						if (Op == db_compare::ne || Op == db_compare::ge || Op == db_compare::le) {
+							Bits ^= 0xF;
+						}
+						Mask[Done / 64] |= Bits << (Done % 64);
+					}
+				}
+				else if constexpr (std::is_integral_v<F> && std::is_signed_v<F> && sizeof(F) == 4)
+				{
+					if (Rows.size() * sizeof(E) > size_t(INT32_MAX)) {
+						return 0;
+					}
+					__m256i const Value8 = _mm256_set1_epi32(int32_t(Value));
+					int32_t S = int32_t(sizeof(E));
+					__m256i Offsets = _mm256_set_epi32(7 * S, 6 * S, 5 * S, 4 * S, 3 * S, 2 * S, S, 0);
+					__m256i const Step = _mm256_set1_epi32(8 * S);
+					for (; Done + 8 <= Rows.size(); Done += 8, Offsets = _mm256_add_epi32(Offsets, Step))
+					{
+						__m256i Fields = _mm256_i32gather_epi32(reinterpret_cast<int const*>(Base), Offsets, 1);
+						__m256i Hit;
+						switch (Op)
+						{
+						case db_compare::eq: case db_compare::ne: Hit = _mm256_cmpeq_epi32(Fields, Value8); break;
+						case db_compare::lt: case db_compare::ge: Hit = _mm256_cmpgt_epi32(Value8, Fields); break;
+						default: Hit = _mm256_cmpgt_epi32(Fields, Value8); break;
+						}
+						uint64_t Bits = uint64_t(_mm256_movemask_ps(_mm256_castsi256_ps(Hit)));
+						if (Op == db_compare::ne || Op == db_compare::ge || Op == db_compare::le) {
+							Bits ^= 0xFF;
+						}
+						Mask[Done / 64] |= Bits << (Done % 64);
+					}
+				}
+				else if constexpr (std::is_same_v<F, double>)
+				{
+					__m256d const Value4 = _mm256_set1_pd(Value);
+					__m256i Offsets = _mm256_set_epi64x(3 * int64_t(sizeof(E)), 2 * int64_t(sizeof(E)), int64_t(sizeof(E)), 0);
+					__m256i const Step = _mm256_set1_epi64x(4 * int64_t(sizeof(E)));
+					for (; Done + 4 <= Rows.size(); Done += 4, Offsets = _mm256_add_epi64(Offsets, Step))
+					{
+						__m256d Fields = _mm256_i64gather_pd(reinterpret_cast<double const*>(Base), Offsets, 1);
+						__m256d Hit;
+						switch (Op)
+						{
+						case db_compare::eq: Hit = _mm256_cmp_pd(Fields, Value4, _CMP_EQ_OQ); break;
+						case db_compare::ne: Hit = _mm256_cmp_pd(Fields, Value4, _CMP_NEQ_UQ); break;
+						case db_compare::lt: Hit = _mm256_cmp_pd(Fields, Value4, _CMP_LT_OQ); break;
+						case db_compare::le: Hit = _mm256_cmp_pd(Fields, Value4, _CMP_LE_OQ); break;
+						case db_compare::gt: Hit = _mm256_cmp_pd(Fields, Value4, _CMP_GT_OQ); break;
+						default: Hit = _mm256_cmp_pd(Fields, Value4, _CMP_GE_OQ); break;
+						}
+						Mask[Done / 64] |= uint64_t(_mm256_movemask_pd(Hit)) << (Done % 64);
+					}
+				}
+				return Done;
+			}
+#endif
+
+		};
+
+
+		// Entry.*Field Op Value, Value is converted to the type of the field
+		template <mz::db::EntryType E, typename F, typename V>
+		db_field_compare<E, F> db_where(F E::* Field, db_compare Op, V Value) noexcept
+		{
+			return db_field_compare<E, F>{ Field, Op, F(Value) };
+		}
+
+
+		// bit i of Mask set when Pred(Rows[i]), through Pred.match() when it has one.
+		// Mask is resized to (size + 63) / 64 words.
+		template <mz::db::EntryType E>
+		void db_match(auto const& Pred, std::span<E const> Rows, std::vector<uint64_t>& Mask)
+		{
+			Mask.resize((Rows.size() + 63) / 64);
+			if constexpr (requires { Pred.match(Rows, Mask.data()); }) {
+				Pred.match(Rows, Mask.data());
+			}
+			else
+			{
+				std::fill(Mask.begin(), Mask.end(), 0);
+				for (size_t i = 0; i < Rows.size(); ++i) {
+					Mask[i / 64] |= uint64_t(bool(Pred(Rows[i]))) << (i % 64);
+				}
+			}
+		}
+
+
+		// calls Func(i) for every bit i set in Mask, in increasing order
+		inline void db_for_each_bit(std::span<uint64_t const> Mask, auto&& Func)
+		{
+			for (size_t w = 0; w < Mask.size(); ++w)
+			{
+				for (uint64_t Bits = Mask[w]; Bits; Bits &= Bits - 1) {
+					Func(w * 64 + size_t(std::countr_zero(Bits)));
+				}
+			}
+		}
+
+
+
+	}
+};
+
+#endif
@@ -0,0 +1,244 @@
+#ifndef DB_STATS_HEADER_FILE
+#define DB_STATS_HEADER_FILE
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+// per-table operation counters and latency histograms, off unless the build defines
+// DB_TABLE_STATS=1. when off every type here is empty and recording compiles to nothing.
+#ifndef DB_TABLE_STATS
+#define DB_TABLE_STATS 0
+#endif
+
+
+namespace mz {
+    namespace db {
+
+
+        // operations timed by db_table
+        enum class db_op {
+            select,
+            update,
+            insert,
+            remove,
+            load,
+        };
+
+        inline constexpr size_t db_op_count{ 5 };
+
+
+        // latency histogram of one operation, in nanoseconds. buckets are HDR style: values
+        // below 2 * Sub are exact, above that each power of 2 is split into Sub buckets, so
+        // a bucket is at most 1/Sub of its value wide. values from 2^MaxBits on share the
+        // last bucket.
+        struct db_histogram
+        {
+            static constexpr uint64_t SubBits{ 3 };
+            static constexpr uint64_t Sub{ 1ull << SubBits };
+            static constexpr uint64_t MaxBits{ 40 };
+            static constexpr size_t Buckets{ size_t((MaxBits - SubBits + 1) * Sub) };
+
+            std::array<uint64_t, Buckets> Counts{};
+            uint64_t Count{ 0 };
+            uint64_t Sum{ 0 };
+            uint64_t Max{ 0 };
+
+            static constexpr size_t bucket(uint64_t Value) noexcept
+            {
+                if (Value < 2 * Sub) {
+                    return size_t(Value);
+                }
+                uint64_t Shift = uint64_t(std::bit_width(Value)) - 1 - SubBits;
+                size_t At = size_t((Shift + 1) * Sub + (Value >> Shift) - Sub);
+                return At < Buckets ? At : Buckets - 1;
+            }
+
+            // largest value counted in bucket At
+            static constexpr uint64_t highest(size_t At) noexcept
+            {
+                if (At < 2 * Sub) {
+                    return At;
+                }
+                uint64_t Shift = At / Sub - 1;
+                return ((Sub + At % Sub + 1) << Shift) - 1;
+            }
+
+            double mean() const noexcept { return Count ? double(Sum) / double(Count) : 0.0; }
+
+            // value at or below which a fraction Q of the samples fall, to bucket precision
+            uint64_t percentile(double Q) const noexcept
+            {
+                if (!Count) {
+                    return 0;
+                }
+                uint64_t Rank = uint64_t(Q * double(Count));
+                Rank = Rank < 1 ? 1 : Rank > Count ? Count : Rank;
+                uint64_t Seen{ 0 };
+                for (size_t i = 0; i < Buckets; ++i)
+                {
+                    Seen += Counts[i];
+                    if (Seen >= Rank) {
+                        return highest(i) < Max ? highest(i) : Max;
+                    }
+                }
+                return Max;
+            }
+        };
+
+
+        // what db_table::stats() returns, Ops is indexed by db_op
+        struct db_stats_snapshot
+        {
+            std::array<db_histogram, db_op_count> Ops{};
+            uint64_t BytesRead{ 0 };
+            uint64_t BytesWritten{ 0 };
+
+            db_histogram const& operator [] (db_op Op) const noexcept { return Ops[size_t(Op)]; }
+        };
+
+
+
+#if DB_TABLE_STATS
+
+        // bytes a storage engine moved from and to its file
+        class db_io_counters
+        {
+        public:
+
+            void read(size_t Bytes) const noexcept { Read.fetch_add(Bytes, std::memory_order_relaxed); }
+            void wrote(size_t Bytes) const noexcept { Written.fetch_add(Bytes, std::memory_order_relaxed); }
+
+            uint64_t bytes_read() const noexcept { return Read.load(std::memory_order_relaxed); }
+            uint64_t bytes_written() const noexcept { return Written.load(std::memory_order_relaxed); }
+
+        private:
+            mutable std::atomic<uint64_t> Read{ 0 };
+            mutable std::atomic<uint64_t> Written{ 0 };
+        };
+
+
+        // each thread records into one of Shards copies of the histograms, picked once per
+        // thread, with relaxed atomic adds and no lock. threads beyond Shards share a copy,
+        // which stays correct, only slower. snapshot() adds the copies up while recording
+        // goes on.
+        class db_stats
+        {
+        public:
+
+            static constexpr size_t Shards{ 16 };
+
+            db_stats() : Shard{ std::make_unique<shard[]>(Shards) } {}
+
+            void record(db_op Op, std::chrono::nanoseconds Elapsed) const noexcept
+            {
+                uint64_t Value = Elapsed.count() > 0 ? uint64_t(Elapsed.count()) : 0;
+                auto& H = Shard[slot()].Ops[size_t(Op)];
+                H.Counts[db_histogram::bucket(Value)].fetch_add(1, std::memory_order_relaxed);
+                H.Count.fetch_add(1, std::memory_order_relaxed);
+                H.Sum.fetch_add(Value, std::memory_order_relaxed);
+                uint64_t Max = H.Max.load(std::memory_order_relaxed);
+                while (Max < Value && !H.Max.compare_exchange_weak(Max, Value, std::memory_order_relaxed)) {}
+            }
+
+            db_stats_snapshot snapshot() const noexcept
+            {
+                db_stats_snapshot Res;
+                for (size_t s = 0; s < Shards; ++s)
+                {
+                    for (size_t op = 0; op < db_op_count; ++op)
+                    {
+                        auto& From = Shard[s].Ops[op];
+                        auto& To = Res.Ops[op];
+                        for (size_t i = 0; i < db_histogram::Buckets; ++i) {
+                            To.Counts[i] += From.Counts[i].load(std::memory_order_relaxed);
+                        }
+                        To.Count += From.Count.load(std::memory_order_relaxed);
+                        To.Sum += From.Sum.load(std::memory_order_relaxed);
+                        uint64_t Max = From.Max.load(std::memory_order_relaxed);
+                        To.Max = To.Max < Max ? Max : To.Max;
+                    }
+                }
+                return Res;
+            }
+
+        private:
+
+            struct histogram
+            {
+                std::array<std::atomic<uint64_t>, db_histogram::Buckets> Counts{};
+                std::atomic<uint64_t> Count{ 0 };
+                std::atomic<uint64_t> Sum{ 0 };
+                std::atomic<uint64_t> Max{ 0 };
+            };
+
+            struct alignas(64) shard
+            {
+                std::array<histogram, db_op_count> Ops{};
+            };
+
+            static size_t slot() noexcept
+            {
+                static std::atomic<size_t> Next{ 0 };
+                thread_local size_t Slot{ Next.fetch_add(1, std::memory_order_relaxed) % Shards };
+                return Slot;
+            }
+
+            std::unique_ptr<shard[]> Shard;
+        };
+
+
+        // records the time from its construction to its destruction as one Op
+        class db_op_timer
+        {
+        public:
+
+            db_op_timer(db_stats const& Stats, db_op Op) noexcept : Stats{ Stats }, Op{ Op } {}
+            db_op_timer(db_op_timer const&) = delete;
+            db_op_timer& operator = (db_op_timer const&) = delete;
+
+            ~db_op_timer() { Stats.record(Op, std::chrono::steady_clock::now() - Start); }
+
+        private:
+            db_stats const& Stats;
+            db_op Op;
+            std::chrono::steady_clock::time_point Start{ std::chrono::steady_clock::now() };
+        };
+
+#else
+
+        class db_io_counters
+        {
+        public:
+            void read(size_t) const noexcept {}
+            void wrote(size_t) const noexcept {}
+            uint64_t bytes_read() const noexcept { return 0; }
+            uint64_t bytes_written() const noexcept { return 0; }
+        };
+
+        class db_stats
+        {
+        public:
+            void record(db_op, std::chrono::nanoseconds) const noexcept {}
+            db_stats_snapshot snapshot() const noexcept { return {}; }
+        };
+
+        class db_op_timer
+        {
+        public:
+            db_op_timer(db_stats const&, db_op) noexcept {}
+        };
+
+#endif
+
+
+
+    }
+};
+
+#endif
@@ -2,22 +2,55 @@
 #define DB_TABLE_HEADER_FILE
 #pragma once
 
+#include <span>
+#include <unordered_set>
+#include <memory>
+#include <thread>
+#include <functional>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <system_error>
+
 #include "db_index_id.h"
 #include "db_index_lin.h"
 #include "db_index_map.h"
+#include "db_index_hash.h"
+#include "db_index_btree.h"
+#include "db_index_pgm.h"
 #include "db_table_file.h"
+#include "db_table_mmap.h"
+#include "db_table_segmented.h"
+#include "db_index_sidecar.h"
+#include "db_index_secondary.h"
+#include "db_row_cache.h"
+#include "db_scan.h"
+#include "db_async.h"
+#include "db_stats.h"
+#include "db_events.h"
+#include "db_write_log.h"
 
 namespace mz {
 	namespace db {
 
 
-        template <mz::db::EntryType E, template<mz::db::KeyType> typename T>
+        // when load_parallel runs the per-row callback
+        enum class db_load_order {
+            any,    // on the worker threads while they read, rows of one worker in order
+            rows,   // on the calling thread in row order once the index is built
+        };
+
+
+        // S is the storage engine, db_table_file or db_table_mmap, both share the same file layout,
+        // or db_table_segmented, which spreads the rows over segment files.
+        template <mz::db::EntryType E, template<mz::db::KeyType> typename T, template<mz::db::EntryType> typename S = mz::db::db_table_file>
         class db_table {
 
 
         public:
             using entry_type = E;
-            using row_type = mz::db::indexed_record<entry_type>;
+            using storage_type = S<entry_type>;
+            using row_type = typename storage_type::row_type;
 
             using key_type = typename entry_type::key_type;
             using map_type = T<key_type>;
@@ -28,10 +61,64 @@ namespace mz {
             using pk_const_iterator = typename map_type::const_iterator;
             using insert_return_type = typename map_type::insert_return_type;
 
+            static_assert(mz::db::StorageType<storage_type>);
+
+            // rows of a table, a storage engine spreading them over several files sets its own
+            static constexpr size_t MaxRows{ [] {
+                if constexpr (requires { storage_type::MaxRows; }) { return storage_type::MaxRows; }
+                else { return size_t(1000000ULL); }
+            }() };
+            static constexpr size_t LoadBlock{ 4096 };
+            static constexpr size_t ScanBytes{ 1 << 20 };
 
             map_type keys;
-            mz::db::db_table_file<entry_type> storage;
+            storage_type storage;
             std::string const Name;
+            std::filesystem::path Path;
+
+            // erased rows that insert() may reuse, most recently erased last.
+            // load() collects the erased rows again unless they come from the sidecar.
+            std::vector<int64_t> FreeRows;
+
+            // with PersistIndex, close() and checkpoint() save keys and FreeRows to the
+            // db_index_sidecar next to the data file and load(Folder) reads them back,
+            // scanning only the rows appended after the last checkpoint.
+            // SidecarRows is the number of rows the sidecar on disk covers, -1 when there
+            // is none, it is removed before any of those rows changes its key.
+            bool PersistIndex{ false };
+            int64_t SidecarRows{ -1 };
+
+            // indexes on keys extracted from the entries, kept in step with the rows by
+            // insert, update and remove and rebuilt from the storage by load().
+            std::vector<std::unique_ptr<db_secondary_base<entry_type>>> Secondary;
+
+            // rows expire TimeToLive after the time of their row_id, or at ExpireAt(Entry)
+            // when it is set. expire_step removes them a chunk at a time.
+            mz::db::db_duration TimeToLive{ 0 };
+            std::function<mz::db::db_time(entry_type const&)> ExpireAt{};
+            int64_t ExpireCursor{ 0 };
+            int64_t ExpiredPrefix{ 0 };     // rows [0, ExpiredPrefix) were dropped in bulk
+            int64_t Expired{ 0 };
+
+            // copies of hot rows served by select, off until cache_rows() sizes it. writes that
+            // bypass the table, straight to storage, are not seen by it.
+            db_row_cache<entry_type> Cache;
+
+            // ring and executor of the async_ calls, see async_io
+            db_io_ring* AsyncRing{ nullptr };
+            db_resume AsyncResume{};
+
+            // latencies of select, update, insert, remove and the loads, see stats()
+            [[no_unique_address]] db_stats Stats;
+
+            // batches of write() logged but maybe not yet durable in the data file, which is
+            // synced and the log emptied once it grows past LogLimit bytes
+            db_write_log<entry_type> Log;
+            int64_t LogLimit{ 16 << 20 };
+
+            // a batch in the write log write() could not apply in full, the log is kept and
+            // writes and checkpoints are refused until open() replays it
+            bool Unapplied{ false };
 
 
 
@@ -39,7 +126,7 @@ namespace mz {
 
             db_table(std::string const& Name) : Name{ Name } {}
 
-            ~db_table() {  }
+            ~db_table() { if (PersistIndex) { close(); } }
 
 
             pk_iterator select_key(keyval_ref KV) noexcept { return keys.select(KV); }
@@ -48,9 +135,15 @@ namespace mz {
 
             bool update(row_type& Row)
             {
+                db_op_timer Timer{ Stats, db_op::update };
                 auto it = select_key(Row);
                 if (it == keys.end()) {
-                    mz::ErrLog << std::format("db_table[{}]::update({}) not found\n", Name, Row.Entry.pk().string());
+                    db_events::post(db_event::update_not_found, Name, Row.Entry.pk());
+                    return true;
+                }
+
+                if (secondary_conflict(Row.Entry, Row.Index)) {
+                    mz::ErrLog << std::format("db_table[{}]::update({}) secondary key exists\n", Name, Row.Entry.pk().string());
                     return true;
                 }
 
@@ -62,6 +155,11 @@ namespace mz {
                 }
                 else {
                     //key(it) = Row.Entry.pk();
+                    Cache.assign(Row.Index, Row.Entry);
+                    for (auto& Index : Secondary) {
+                        Index->update(Row.Entry, Row.Index);
+                    }
+                    compact_update(Row);
                     return false;
                 }
             }
@@ -73,21 +171,30 @@ namespace mz {
 
             bool remove(row_type& Row)
             {
+                db_op_timer Timer{ Stats, db_op::remove };
                 auto it = select_key(Row);
                 if (it == keys.end()) {
-                    mz::ErrLog << std::format("db_table[{}]::remove({}) not found\n", Name, Row.Entry.pk().string());
+                    db_events::post(db_event::remove_not_found, Name, Row.Entry.pk());
                     Row.Index = -1;
                     return true;
                 }
 
                 if (Row.Index + 1 == storage.count())
                 {
+                    invalidate_sidecar(Row.Index);
+                    compact_remove(Row, true);
+                    Cache.erase(Row.Index);
                     storage.pop();
                     keys.erase(it);
+                    for (auto& Index : Secondary) {
+                        Index->erase(Row.Index);
+                    }
                     return false;
                 }
 
                 Row.Entry.erase();
+                invalidate_sidecar(Row.Index);
+                Cache.erase(Row.Index);
                 if (storage.update(Row))
                 {
                     mz::ErrLog << std::format("db_table[{}]::rempve({}) corrupted\n", Name, Row.Entry.pk().string());
@@ -96,6 +203,11 @@ namespace mz {
                 }
 
                 keys.erase(it);
+                for (auto& Index : Secondary) {
+                    Index->erase(Row.Index);
+                }
+                FreeRows.push_back(Row.Index);
+                compact_remove(Row, false);
                 return false;
             }
 
@@ -105,19 +217,26 @@ namespace mz {
 
             bool select(row_type& Row)
             {
+                db_op_timer Timer{ Stats, db_op::select };
                 auto it = select_key(Row);
                 if (it == keys.end()) {
-                    mz::ErrLog << std::format("db_table[{}]::select({}) not found\n", Name, Row.Entry.pk().string());
+                    db_events::post(db_event::select_not_found, Name, Row.Entry.pk());
                     Row.Index = -1;
                     return true;
                 }
 
                 key_type Key{ Row.Entry.pk() };
-                if (storage.select(Row)) {
+                if (auto Cached = Cache.find(Row.Index)) {
+                    Row.Entry = *Cached;
+                }
+                else if (storage.select(Row)) {
                     mz::ErrLog << std::format("db_table[{}]::select({}) corrupted\n", Name, Row.Entry.pk().string());
                     Row.Index = -2;
                     return true;
                 }
+                else {
+                    Cache.put(Row.Index, Row.Entry);
+                }
 
                 if (Key != Row.Entry.pk()) {
                     mz::ErrLog << std::format("db_table[{}]::select({}) updated\n", Name, Row.Entry.pk().string());
@@ -132,23 +251,48 @@ namespace mz {
 
             int load(std::filesystem::path const& Folder, auto&& Func)
             {
+                db_op_timer Timer{ Stats, db_op::load };
                 if (int Res = open(Folder); Res) { return Res; }
 
-                row_type Row;
                 keys.clear();
                 keys.reserve(storage.count());
+                FreeRows.clear();
+                int64_t First = index_dropped();
+                if (First < 0) {
+                    return 5000;
+                }
+                if (int Res = load_rows(First, Func); Res) {
+                    return Res;
+                }
+                return index_rows(0);
+            }
+
+            // collects erased rows and calls Func on rows [First, count())
+            int load_rows(int64_t First, auto&& Func)
+            {
+                row_type Row;
                 //DataMsg = std::format("db_table[{}]::load: ", Name);
 
-                for (Row.Index = 0; Row.Index < storage.count(); Row.Index++)
+                if (First < storage.count() && storage.seekg_index(First))
+                {
+                    mz::ErrLog << std::format("db_table[{}]::load:storage::seekg_index({}) file error: {}\n", Name, First, storage.report_errors());
+                    return 5000;
+                }
+
+                for (Row.Index = First; Row.Index < storage.count(); Row.Index++)
                 {
                     if (storage.select_next(Row.Entry))
                     {
-                        mz::ErrLog << std::format("db_table[{}]::load:storage::select_next({}) file error: {}\n", Name, Row.Index, storage.File.eflags().value);
+                        mz::ErrLog << std::format("db_table[{}]::load:storage::select_next({}) file error: {}\n", Name, Row.Index, storage.report_errors());
                         //DataMsg += 
                         //fmt::print("{}\n", DataMsg);
                         return 5000;
                     }
 
+                    if (Row.Entry.erased()) {
+                        FreeRows.push_back(Row.Index);
+                    }
+
                     int Res = Func(Row);
                     if (Res) {
                         //fmt::print("{}\n", DataMsg);
@@ -164,8 +308,13 @@ namespace mz {
 
             int load(std::filesystem::path const& Folder)
             {
+                // erased rows keep their key only in a monotone index, which maps keys to
+                // rows by position, anywhere else the key would outlive a reused row.
                 auto Inserter = [&](row_type& Row) noexcept -> int
                     {
+                        if (!map_type::monotone && Row.Entry.erased()) {
+                            return 0;
+                        }
                         if (!keys.insert(Row.Entry.pk(), Row.Index).second)
                         {
                             mz::ErrLog << std::format("db_table[{}]::load:index_map::insert({}) duplicate.\n", Name, Row.Index);
@@ -174,53 +323,1937 @@ namespace mz {
                         else { return 0; }
                     };
 
-                return load(Folder, std::forward<decltype(Inserter)>(Inserter));
+                if (!PersistIndex) {
+                    return load(Folder, std::forward<decltype(Inserter)>(Inserter));
+                }
+
+                db_op_timer Timer{ Stats, db_op::load };
+                if (int Res = open(Folder); Res) { return Res; }
+                keys.clear();
+                FreeRows.clear();
+                int64_t First = load_sidecar();
+                if (!First)
+                {
+                    keys.reserve(storage.count());
+                    if ((First = index_dropped()) < 0) {
+                        return 5000;
+                    }
+                }
+                std::erase_if(FreeRows, [&](int64_t Row) { return Row < ExpiredPrefix; });
+                if (int Res = load_rows(First, Inserter); Res) {
+                    return Res;
+                }
+                return index_rows(0);
+            }
+
+
+            void persist_index(bool Enable) noexcept { PersistIndex = Enable; }
+
+            // counts and latency histograms of the operations so far with the bytes the storage
+            // read and wrote, all zero unless built with DB_TABLE_STATS=1. safe to call while
+            // other threads operate on the table.
+            db_stats_snapshot stats() const noexcept
+            {
+                auto Snapshot = Stats.snapshot();
+                if constexpr (requires { storage.IoStats.bytes_read(); })
+                {
+                    Snapshot.BytesRead = storage.IoStats.bytes_read();
+                    Snapshot.BytesWritten = storage.IoStats.bytes_written();
+                }
+                return Snapshot;
+            }
+
+            // makes the data file durable, then saves the index covering all of its rows
+            int checkpoint()
+            {
+                if (Path.empty()) {
+                    return 0;
+                }
+                if (Unapplied)
+                {
+                    mz::ErrLog << std::format("db_table[{}]::checkpoint() write log holds a batch not applied, reopen to replay it\n", Name);
+                    return 10006;
+                }
+                if (storage.sync())
+                {
+                    mz::ErrLog << std::format("db_table[{}]::checkpoint() storage sync error: {}\n", Name, storage.report_errors());
+                    return 8001;
+                }
+                if (Log.reset())
+                {
+                    mz::ErrLog << std::format("db_table[{}]::checkpoint() write log reset error\n", Name);
+                    return 10005;
+                }
+
+                db_index_sidecar::header Header{};
+                Header.Generation = uint64_t(mz::db::db_time::now().tsep);
+                Header.Rows = storage.count();
+                Header.FileSize = storage_bytes();
+                Header.LastRow = row_stamp(Header.Rows - 1);
+
+                if (db_index_sidecar::write(sidecar_path(), keys, std::span<int64_t const>{ FreeRows }, Header))
+                {
+                    mz::ErrLog << std::format("db_table[{}]::checkpoint() sidecar write error\n", Name);
+                    return 8002;
+                }
+                SidecarRows = Header.Rows;
+                return 0;
+            }
+
+            // syncs the storage and empties the write log, whose batches it then holds
+            int checkpoint_log()
+            {
+                if (Unapplied)
+                {
+                    mz::ErrLog << std::format("db_table[{}]::checkpoint_log() write log holds a batch not applied, reopen to replay it\n", Name);
+                    return 10006;
+                }
+                if (!Log.size()) {
+                    return 0;
+                }
+                if (storage.sync())
+                {
+                    mz::ErrLog << std::format("db_table[{}]::checkpoint_log() storage sync error: {}\n", Name, storage.report_errors());
+                    return 8001;
+                }
+                if (Log.reset())
+                {
+                    mz::ErrLog << std::format("db_table[{}]::checkpoint_log() write log reset error\n", Name);
+                    return 10005;
+                }
+                return 0;
+            }
+
+            // checkpoints when PersistIndex is set, otherwise only syncs what the write log
+            // holds, and closes the storage
+            int close()
+            {
+                if (Path.empty()) {
+                    return 0;
+                }
+                compact_abort();
+                int Res = PersistIndex ? checkpoint() : checkpoint_log();
+                storage.close();
+                Log.close();
+                Path.clear();
+                return Res;
             }
 
 
+            // insert, update and remove operations applied by write() all or none
+            class write_batch
+            {
+            public:
 
+                void insert(entry_type const& Entry) { Ops.push_back({ op::insert, row_type{ -1, Entry } }); }
+                void update(row_type const& Row) { Ops.push_back({ op::update, Row }); }
+                void remove(row_type const& Row) { Ops.push_back({ op::remove, Row }); }
 
+                void clear() noexcept { Ops.clear(); Failed = -1; }
+                bool empty() const noexcept { return Ops.empty(); }
+                size_t size() const noexcept { return Ops.size(); }
 
+                // the row of operation i once write() returned, -2 when applying it failed
+                row_type const& row(size_t i) const noexcept { return Ops[i].Row; }
 
+                // operation write() rejected, -1 when none was
+                int64_t Failed{ -1 };
 
+            private:
+                friend class db_table;
 
+                enum class op : uint8_t { insert, update, remove };
 
-            int open(std::filesystem::path const& Folder)
+                struct staged
+                {
+                    op Op;
+                    row_type Row;
+                };
+
+                std::vector<staged> Ops;
+            };
+
+
+            // applies the operations of Batch all or none: each is checked against the indexes
+            // first, then the row images go to the write log with one write and one sync and only
+            // then to the storage, without syncing it. an operation that does not apply, e.g. an
+            // update or remove of a missing key or an insert of an existing one, rejects the batch
+            // and is returned in Batch.Failed. a storage error after the batch was logged stops
+            // applying it, the operations from there on get Row.Index -2 and the table refuses
+            // writes and checkpoints until the next open() replays the batch from the log, which
+            // is kept until then. operations are checked against the
+            // table and the inserts before them: a row the batch removes cannot be updated or
+            // removed again, nor reused or its key inserted again by the same batch.
+            int write(write_batch& Batch)
             {
-                //DataMsg.clear();
-                if (int Res = storage.open(Folder / Name, 1000000ULL); Res)
+                using record = typename db_write_log<entry_type>::record;
+
+                Batch.Failed = -1;
+                if (Batch.Ops.empty()) {
+                    return 0;
+                }
+                if (Unapplied)
                 {
-                    //DataMsg = std::format("db_table[{}]::open: storage.open return with errors\n{}", Name, storage.ErrMsg);
-                    //fmt::print("{}\n", DataMsg);
-                    return Res;
+                    mz::ErrLog << std::format("db_table[{}]::write() write log holds a batch not applied, reopen to replay it\n", Name);
+                    return 10006;
+                }
+                if (!Log.is_open() && Log.open(db_write_log<entry_type>::path_of(Path), [](record const&) { return false; }))
+                {
+                    mz::ErrLog << std::format("db_table[{}]::write() write log open error\n", Name);
+                    return 10001;
+                }
+
+                // stage: index the inserted keys, undone when the batch is rejected
+                std::vector<key_type> Inserted;
+                std::vector<int64_t> Reused;
+                std::vector<key_type> Removed;
+                std::unordered_set<int64_t> RemovedRows;
+                auto Undo = [&]
+                    {
+                        for (auto Key = Inserted.rbegin(); Key != Inserted.rend(); ++Key)
+                        {
+                            if (auto it = keys.find(*Key); it != keys.end()) {
+                                keys.pop(it);
+                            }
+                        }
+                        FreeRows.insert(FreeRows.end(), Reused.rbegin(), Reused.rend());
+                    };
+
+                int64_t Next = next_row();
+                for (size_t i = 0; i < Batch.Ops.size(); ++i)
+                {
+                    auto& [Op, Row] = Batch.Ops[i];
+                    bool Failed{ false };
+                    if (Op == write_batch::op::insert)
+                    {
+                        bool Reuse = !FreeRows.empty() && FreeRows.back() < storage.count() && !Compaction;
+                        Row.Index = Reuse ? FreeRows.back() : Next;
+                        Failed = secondary_conflict(Row.Entry, -1);
+                        bool Indexed = !Failed && keys.insert(Row.Entry.pk(), Row.Index).second;
+                        if (!Failed && !Indexed && Reuse)
+                        {
+                            Reuse = false;
+                            Row.Index = Next;
+                            Indexed = keys.insert(Row.Entry.pk(), Row.Index).second;
+                        }
+                        Failed = !Indexed;
+                        if (Indexed)
+                        {
+                            Inserted.push_back(Row.Entry.pk());
+                            if (Reuse) {
+                                Reused.push_back(FreeRows.back());
+                                FreeRows.pop_back();
+                            }
+                            else {
+                                ++Next;
+                            }
+                        }
+                    }
+                    else if (Op == write_batch::op::update) {
+                        Failed = select_key(Row) == keys.end() || RemovedRows.contains(Row.Index) || secondary_conflict(Row.Entry, Row.Index);
+                    }
+                    else
+                    {
+                        Failed = select_key(Row) == keys.end() || !RemovedRows.insert(Row.Index).second;
+                        if (!Failed)
+                        {
+                            Removed.push_back(Row.Entry.pk());
+                            Row.Entry.erase();
+                        }
+                    }
+
+                    if (Failed)
+                    {
+                        mz::ErrLog << std::format("db_table[{}]::write() operation {} on {} rejected\n", Name, i, Row.Entry.pk().string());
+                        Undo();
+                        Batch.Failed = int64_t(i);
+                        return 10002;
+                    }
+                }
+
+                std::vector<record> Records;
+                Records.reserve(Batch.Ops.size());
+                for (auto& Staged : Batch.Ops) {
+                    Records.push_back(record{ Staged.Row.Index, Staged.Row.Entry });
+                }
+                if (Log.append(std::span<record const>{ Records }))
+                {
+                    mz::ErrLog << std::format("db_table[{}]::write() write log append error\n", Name);
+                    Undo();
+                    return 10003;
+                }
+
+                // apply, as insert, update and remove do
+                auto RemovedKey = Removed.begin();
+                for (size_t i = 0; i < Batch.Ops.size(); ++i)
+                {
+                    auto& [Op, Row] = Batch.Ops[i];
+                    invalidate_sidecar(Row.Index);
+                    bool Failed = Op == write_batch::op::insert && Row.Index == storage.count() ? storage.insert(Row) : storage.update(Row);
+                    key_type Key = Op == write_batch::op::remove ? *RemovedKey++ : Row.Entry.pk();
+                    if (Failed)
+                    {
+                        mz::ErrLog << std::format("db_table[{}]::write({}) storage error, {} operations left to the write log replay: {}\n", Name, Key.string(), Batch.Ops.size() - i, storage.report_errors());
+                        for (size_t j = i; j < Batch.Ops.size(); ++j) {
+                            Batch.Ops[j].Row.Index = -2;
+                        }
+                        Unapplied = true;
+                        return 10004;
+                    }
+
+                    if (Op == write_batch::op::insert)
+                    {
+                        Cache.erase(Row.Index);
+                        secondary_insert(Row);
+                    }
+                    else if (Op == write_batch::op::update)
+                    {
+                        Cache.assign(Row.Index, Row.Entry);
+                        for (auto& Index : Secondary) {
+                            Index->update(Row.Entry, Row.Index);
+                        }
+                        compact_update(Row);
+                    }
+                    else
+                    {
+                        Cache.erase(Row.Index);
+                        if (auto it = keys.find(Key); it != keys.end()) {
+                            keys.erase(it);
+                        }
+                        for (auto& Index : Secondary) {
+                            Index->erase(Row.Index);
+                        }
+                        FreeRows.push_back(Row.Index);
+                        compact_remove(Row, false);
+                    }
+                }
+
+                if (Log.size() > LogLimit) {
+                    return checkpoint_log();
                 }
                 return 0;
             }
 
+            std::filesystem::path sidecar_path() const { return db_index_sidecar::path_of(Path); }
 
 
-        protected:
 
 
 
-            bool insert(row_type& Row)
+
+
+
+
+            // same result as load(Folder), rows are split into one range per thread and
+            // read in blocks of LoadBlock rows. each worker collects the keys of its range,
+            // sorted for an unordered index or checked for order in a monotone one, the
+            // ranges are merged pairwise in parallel and the index is built with
+            // insert_sorted.
+            // Func(Row) returning non zero stops the load and is returned. with
+            // db_load_order::any it is called concurrently from the workers before the
+            // index exists, so it must be thread safe and must not touch the table.
+            int load_parallel(std::filesystem::path const& Folder, size_t Threads, auto&& Func, db_load_order Order = db_load_order::any)
             {
-                Row.Index = storage.count();
-                auto [it, success] = keys.insert(Row.Entry.pk(), Row.Index);
-                if (!success) {
-                    mz::ErrLog << std::format("db_table::insert({}) failed\n", Row.Entry.pk().string());
-                    Row.Index = -1;
-                    return true;
+                db_op_timer Timer{ Stats, db_op::load };
+                if (int Res = open(Folder); Res) { return Res; }
+
+                keys.clear();
+                FreeRows.clear();
+                size_t Rows = size_t(storage.count());
+                if (!Rows) {
+                    return 0;
                 }
-                if (storage.insert(Row))
+                int64_t Dropped = index_dropped();
+                if (Dropped < 0) {
+                    return 5000;
+                }
+                size_t Start = size_t(Dropped);
+                Threads = std::clamp<size_t>(Threads, 1, (Rows - Start + LoadBlock - 1) / LoadBlock);
+
+                // a segmented storage is split at segment boundaries, each worker reads whole files
+                size_t Align{ 1 };
+                if constexpr (requires { storage.segment_rows(); }) {
+                    Align = storage.segment_rows();
+                }
+                auto Split = [&](size_t t) { return t == Threads ? Rows : std::max(Start, (Start + (Rows - Start) * t / Threads) / Align * Align); };
+
+                std::vector<load_part> Ranges(Threads);
                 {
-                    mz::ErrLog << std::format("db_table::insert({}) corrupted\n", Row.Entry.pk().string());
-                    keys.pop(it);
-                    Row.Index = -2;
-                    return true;
+                    std::vector<std::jthread> Workers;
+                    for (size_t t = 0; t < Threads; ++t)
+                    {
+                        Ranges[t].First = Split(t);
+                        Ranges[t].Last = Split(t + 1);
+                        Workers.emplace_back([&, t] { load_worker(Ranges[t], Func, Order == db_load_order::any); });
+                    }
                 }
 
-                return false;
+                for (auto& Range : Ranges)
+                {
+                    if (Range.Res == 5000) {
+                        mz::ErrLog << std::format("db_table[{}]::load_parallel:storage::select_range({}) file error: {}\n", Name, Range.Failed, storage.report_errors());
+                    }
+                    else if (Range.Res == 6000) {
+                        mz::ErrLog << std::format("db_table[{}]::load_parallel:index_map::insert({}) duplicate.\n", Name, Range.Failed);
+                    }
+                    if (Range.Res) {
+                        return Range.Res;
+                    }
+                    FreeRows.insert(FreeRows.end(), Range.Free.begin(), Range.Free.end());
+                }
+
+                if (int Res = load_merge(Ranges); Res) {
+                    keys.clear();
+                    FreeRows.clear();
+                    return Res;
+                }
+
+                if (Order == db_load_order::rows)
+                {
+                    std::vector<entry_type> Block(std::min(LoadBlock, Rows - Start));
+                    row_type Row;
+                    for (size_t First = Start; First < Rows; First += Block.size())
+                    {
+                        size_t Count = std::min(Block.size(), Rows - First);
+                        if (storage.select_range(int64_t(First), Block.data(), Count))
+                        {
+                            mz::ErrLog << std::format("db_table[{}]::load_parallel:storage::select_range({}) file error: {}\n", Name, First, storage.report_errors());
+                            return 5000;
+                        }
+                        for (size_t i = 0; i < Count; ++i)
+                        {
+                            Row.Index = int64_t(First + i);
+                            Row.Entry = Block[i];
+                            if (int Res = Func(Row); Res) {
+                                return Res;
+                            }
+                        }
+                    }
+                }
+                return index_rows(0);
+            }
+
+            int load_parallel(std::filesystem::path const& Folder, size_t Threads)
+            {
+                return load_parallel(Folder, Threads, [](row_type&) noexcept -> int { return 0; });
+            }
+
+
+
+
+
+
+
+
+
+            // live rows with keys in [From, To], read a block of up to LoadBlock consecutive
+            // rows at a time, in place from a db_table_mmap. rows come in row order, which
+            // is key order unless rows were reused. the table must not be changed while
+            // the cursor is in use.
+            class scan_cursor
+            {
+            public:
+
+                using run_type = std::pair<int64_t, int64_t>;   // first row, row count
+
+                scan_cursor(db_table& Table, std::vector<run_type> Runs) : Table{ &Table }, Runs{ std::move(Runs) } {}
+
+                // false once the range is exhausted or a read failed
+                bool next(row_type& Row)
+                {
+                    for (;;)
+                    {
+                        while (Pos < View.size())
+                        {
+                            size_t At = Pos++;
+                            if (!View[At].erased())
+                            {
+                                Row.Index = Base + int64_t(At);
+                                Row.Entry = View[At];
+                                return true;
+                            }
+                        }
+                        if (fetch()) {
+                            return false;
+                        }
+                    }
+                }
+
+                bool failed() const noexcept { return Failed; }
+
+                // rows the cursor reads, erased ones among them
+                int64_t rows() const noexcept
+                {
+                    int64_t Rows{ 0 };
+                    for (auto& Run : Runs) {
+                        Rows += Run.second;
+                    }
+                    return Rows;
+                }
+
+            private:
+
+                // true when there is nothing left to read
+                bool fetch()
+                {
+                    if (Failed || Run == Runs.size()) {
+                        return true;
+                    }
+
+                    auto [First, Count] = Runs[Run];
+                    size_t Take = size_t(std::min<int64_t>(Count - Done, int64_t(LoadBlock)));
+                    Base = First + Done;
+                    if constexpr (requires { Table->storage.view_range(Base, Take); })
+                    {
+                        View = Table->storage.view_range(Base, Take);
+                        Failed = View.empty();
+                    }
+                    else
+                    {
+                        Block.resize(Take);
+                        Failed = Table->storage.select_range(Base, Block.data(), Take);
+                        View = std::span<entry_type const>{ Block.data(), Take };
+                    }
+                    if (Failed) {
+                        mz::ErrLog << std::format("db_table[{}]::scan_cursor::fetch({},{}) file error: {}\n", Table->Name, Base, Take, Table->storage.report_errors());
+                        View = {};
+                        return true;
+                    }
+
+                    Pos = 0;
+                    Done += int64_t(Take);
+                    if (Done == Count) {
+                        ++Run;
+                        Done = 0;
+                    }
+                    return false;
+                }
+
+                db_table* Table;
+                std::vector<run_type> Runs;
+                size_t Run{ 0 };
+                int64_t Done{ 0 };
+                int64_t Base{ 0 };
+                size_t Pos{ 0 };
+                std::vector<entry_type> Block;
+                std::span<entry_type const> View;
+                bool Failed{ false };
+            };
+
+
+            // rows whose key time lies in [From, To], found through lower_bound and upper_bound
+            // of an ordered index. rows of a monotone index form one run, otherwise the rows
+            // are sorted and consecutive ones joined into runs.
+            scan_cursor scan(mz::db::db_time From, mz::db::db_time To)
+                requires (map_type::ordered && std::constructible_from<key_type, mz::db::db_time>)
+            {
+                std::vector<typename scan_cursor::run_type> Runs;
+                if (key_type{ To } < key_type{ From }) {
+                    return scan_cursor{ *this, std::move(Runs) };
+                }
+
+                auto First = keys.lower_bound(key_type{ From });
+                auto Last = keys.upper_bound(key_type{ To });
+                if constexpr (map_type::monotone)
+                {
+                    int64_t Lo = std::max(int64_t(First - keys.begin()), ExpiredPrefix);
+                    int64_t Hi = int64_t(Last - keys.begin());
+                    if constexpr (requires { keys.live_runs(size_t{}, size_t{}, size_t{}, [](size_t, size_t) {}); })
+                    {
+                        // runs of erased rows longer than a load block are not read at all
+                        if (Lo < Hi) {
+                            keys.live_runs(size_t(Lo), size_t(Hi), LoadBlock, [&](size_t Row, size_t Count) { Runs.emplace_back(int64_t(Row), int64_t(Count)); });
+                        }
+                    }
+                    else if (Lo < Hi) {
+                        Runs.emplace_back(Lo, Hi - Lo);
+                    }
+                }
+                else
+                {
+                    std::vector<int64_t> Rows;
+                    for (; First != Last; ++First) {
+                        Rows.push_back(First->second);
+                    }
+                    std::sort(Rows.begin(), Rows.end());
+                    for (int64_t Row : Rows)
+                    {
+                        if (!Runs.empty() && Runs.back().first + Runs.back().second == Row) {
+                            ++Runs.back().second;
+                        }
+                        else {
+                            Runs.emplace_back(Row, 1);
+                        }
+                    }
+                }
+                return scan_cursor{ *this, std::move(Runs) };
+            }
+
+
+
+
+            // rows matching Pred(Entry), erased rows never match. Pred may be a db_where() field
+            // compare, which is tested a block at a time with SIMD. storage is read ScanBytes at
+            // a time in blocks starting at multiples of the block size, in place from a
+            // db_table_mmap.
+            int select_where(auto const& Pred, std::vector<int64_t>& Rows)
+            {
+                return scan_where(Pred, [&](int64_t Base, std::span<entry_type const>, size_t i) { Rows.push_back(Base + int64_t(i)); });
+            }
+
+            int select_where(auto const& Pred, std::vector<row_type>& Rows)
+            {
+                return scan_where(Pred, [&](int64_t Base, std::span<entry_type const> View, size_t i) { Rows.push_back(row_type{ Base + int64_t(i), View[i] }); });
+            }
+
+            // read-modify-write over the rows matching Pred: Func(Entry) returns true when it
+            // changed the entry. only changed rows are written back, one write per run of
+            // them, runs less than a page apart are joined. a change to the primary key or one
+            // breaking a unique secondary index is dropped and reported, the scan goes on.
+            int modify_where(auto const& Pred, auto&& Func, int64_t* Modified = nullptr)
+            {
+                size_t BlockRows = scan_block();
+                std::vector<entry_type> Block(std::min(BlockRows, size_t(std::max<int64_t>(storage.count(), 0))));
+                std::vector<uint64_t> Mask;
+                std::vector<uint64_t> Dirty;
+                int Res{ 0 };
+                int64_t Changed{ 0 };
+
+                for (int64_t Base = scan_first(BlockRows); Base < storage.count(); Base += int64_t(BlockRows))
+                {
+                    size_t Count = size_t(std::min<int64_t>(int64_t(BlockRows), storage.count() - Base));
+                    if (storage.select_range(Base, Block.data(), Count))
+                    {
+                        mz::ErrLog << std::format("db_table[{}]::modify_where:storage::select_range({}) file error: {}\n", Name, Base, storage.report_errors());
+                        return 5000;
+                    }
+
+                    db_match(Pred, std::span<entry_type const>{ Block.data(), Count }, Mask);
+                    Dirty.assign(Mask.size(), 0);
+                    db_for_each_bit(Mask, [&](size_t i)
+                        {
+                            auto& Entry = Block[i];
+                            if (Entry.erased()) {
+                                return;
+                            }
+                            entry_type Before{ Entry };
+                            if (!Func(Entry)) {
+                                Entry = Before;
+                                return;
+                            }
+                            if (Entry.pk() != Before.pk())
+                            {
+                                mz::ErrLog << std::format("db_table[{}]::modify_where({}) primary key changed\n", Name, Before.pk().string());
+                                Entry = Before;
+                                Res = Res ? Res : 6002;
+                                return;
+                            }
+                            if (secondary_conflict(Entry, Base + int64_t(i)))
+                            {
+                                mz::ErrLog << std::format("db_table[{}]::modify_where({}) secondary key exists\n", Name, Before.pk().string());
+                                Entry = Before;
+                                Res = Res ? Res : 6001;
+                                return;
+                            }
+                            Dirty[i / 64] |= uint64_t(1) << (i % 64);
+                        });
+
+                    // runs [First, Last) of rows to write, clean rows inside a run are written unchanged
+                    constexpr size_t Gap{ std::max<size_t>(1, 4096 / sizeof(entry_type)) };
+                    size_t First{ 0 };
+                    size_t Last{ 0 };
+                    auto Flush = [&]
+                        {
+                            if (First == Last) {
+                                return false;
+                            }
+                            if (storage.update_range(Base + int64_t(First), Block.data() + First, Last - First))
+                            {
+                                mz::ErrLog << std::format("db_table[{}]::modify_where:storage::update_range({}) file error: {}\n", Name, Base + int64_t(First), storage.report_errors());
+                                return true;
+                            }
+                            return false;
+                        };
+                    bool Failed{ false };
+                    db_for_each_bit(Dirty, [&](size_t i)
+                        {
+                            if (Failed) {
+                                return;
+                            }
+                            if (First != Last && i - Last > Gap) {
+                                Failed = Flush();
+                                First = Last;
+                            }
+                            if (First == Last) {
+                                First = i;
+                            }
+                            Last = i + 1;
+                        });
+                    if (Failed || Flush()) {
+                        return 5001;
+                    }
+
+                    db_for_each_bit(Dirty, [&](size_t i)
+                        {
+                            row_type Row{ Base + int64_t(i), Block[i] };
+                            Cache.assign(Row.Index, Row.Entry);
+                            for (auto& Index : Secondary) {
+                                Index->update(Row.Entry, Row.Index);
+                            }
+                            compact_update(Row);
+                            ++Changed;
+                        });
+                }
+
+                if (Modified) {
+                    *Modified = Changed;
+                }
+                return Res;
+            }
+
+
+
+
+            // keeps copies of up to Rows rows selected recently, 0 turns the cache off
+            void cache_rows(size_t Rows) { Cache.resize(Rows); }
+
+
+
+
+            // adds a secondary index on Extract(Entry) and indexes the rows already loaded.
+            // returns the index to query it, nullptr when Name is taken or a unique index
+            // finds a key twice.
+            template <mz::db::db_index_kind Kind = db_index_kind::ordered, typename Hash = void, typename Extract>
+            auto* add_index(std::string const& IndexName, Extract Func, bool Unique = false)
+            {
+                using index_type = db_secondary<entry_type, Extract, Kind, Hash>;
+                if (secondary(IndexName))
+                {
+                    mz::ErrLog << std::format("db_table[{}]::add_index({}) exists\n", Name, IndexName);
+                    return static_cast<index_type*>(nullptr);
+                }
+
+                auto Index = std::make_unique<index_type>(IndexName, Unique, std::move(Func));
+                auto Ptr = Index.get();
+                Secondary.push_back(std::move(Index));
+                if (!Path.empty() && index_rows(Secondary.size() - 1))
+                {
+                    Secondary.pop_back();
+                    return static_cast<index_type*>(nullptr);
+                }
+                return Ptr;
+            }
+
+            db_secondary_base<entry_type>* secondary(std::string const& IndexName) noexcept
+            {
+                for (auto& Index : Secondary) {
+                    if (Index->Name == IndexName) { return Index.get(); }
+                }
+                return nullptr;
+            }
+
+            void drop_index(std::string const& IndexName)
+            {
+                std::erase_if(Secondary, [&](auto& Index) { return Index->Name == IndexName; });
+            }
+
+            // reads the first row with Key in the secondary Index
+            bool select_by(auto const& Index, auto const& Key, row_type& Row)
+            {
+                Row.Index = Index.find(Key);
+                if (Row.Index < 0) {
+                    mz::ErrLog << std::format("db_table[{}]::select_by({}) not found\n", Name, Index.Name);
+                    return true;
+                }
+                if (storage.select(Row)) {
+                    mz::ErrLog << std::format("db_table[{}]::select_by({}) corrupted\n", Name, Index.Name);
+                    Row.Index = -2;
+                    return true;
+                }
+                return false;
+            }
+
+
+
+
+            // with a ring set by async_io, async_select, async_update and async_remove queue their
+            // storage I/O on it and suspend the awaiting coroutine. the index, cache and secondary
+            // indexes are consulted before suspending, so an operation without I/O does not
+            // suspend. all operations queued before the owner calls AsyncRing->wait() or poll()
+            // go to the kernel in one submission. operations on the same row must not overlap.
+            // without a ring, or on a storage without async I/O, they run synchronously.
+            void async_io(db_io_ring* Ring, db_resume Resume = {})
+            {
+                AsyncRing = Ring;
+                AsyncResume = std::move(Resume);
+            }
+
+            auto async_select(row_type& Row)
+            {
+                auto Start = [this, &Row, Key = Row.Entry.pk()](auto Complete)
+                    {
+                        if constexpr (async_storage)
+                        {
+                            storage.async_select(*AsyncRing, Row, [this, Key, Complete](row_type& Row, bool Failed) mutable
+                                {
+                                    if (Failed)
+                                    {
+                                        mz::ErrLog << std::format("db_table[{}]::async_select({}) corrupted\n", Name, Key.string());
+                                        Row.Index = -2;
+                                    }
+                                    else
+                                    {
+                                        Cache.put(Row.Index, Row.Entry);
+                                        if (Key != Row.Entry.pk()) {
+                                            mz::ErrLog << std::format("db_table[{}]::async_select({}) updated\n", Name, Row.Entry.pk().string());
+                                        }
+                                    }
+                                    Complete(Failed);
+                                });
+                        }
+                    };
+                using awaitable = db_awaitable<decltype(Start)>;
+
+                if (!async_ready()) {
+                    return awaitable{ select(Row) };
+                }
+                auto it = select_key(Row);
+                if (it == keys.end())
+                {
+                    db_events::post(db_event::async_select_not_found, Name, Row.Entry.pk());
+                    Row.Index = -1;
+                    return awaitable{ true };
+                }
+                if (auto Cached = Cache.find(Row.Index))
+                {
+                    Row.Entry = *Cached;
+                    return awaitable{ false };
+                }
+                return awaitable{ std::move(Start), &AsyncResume };
+            }
+
+            auto async_update(row_type& Row)
+            {
+                auto Start = [this, &Row](auto Complete)
+                    {
+                        if constexpr (async_storage)
+                        {
+                            storage.async_update(*AsyncRing, Row, [this, Complete](row_type const& Row, bool Failed) mutable
+                                {
+                                    if (Failed)
+                                    {
+                                        mz::ErrLog << std::format("db_table[{}]::async_update({}) corrupted\n", Name, Row.Entry.pk().string());
+                                        Row.Index = -2;
+                                    }
+                                    else
+                                    {
+                                        Cache.assign(Row.Index, Row.Entry);
+                                        for (auto& Index : Secondary) {
+                                            Index->update(Row.Entry, Row.Index);
+                                        }
+                                        compact_update(Row);
+                                    }
+                                    Complete(Failed);
+                                });
+                        }
+                    };
+                using awaitable = db_awaitable<decltype(Start)>;
+
+                if (!async_ready()) {
+                    return awaitable{ update(Row) };
+                }
+                if (select_key(Row) == keys.end())
+                {
+                    db_events::post(db_event::async_update_not_found, Name, Row.Entry.pk());
+                    return awaitable{ true };
+                }
+                if (secondary_conflict(Row.Entry, Row.Index))
+                {
+                    mz::ErrLog << std::format("db_table[{}]::async_update({}) secondary key exists\n", Name, Row.Entry.pk().string());
+                    return awaitable{ true };
+                }
+                return awaitable{ std::move(Start), &AsyncResume };
+            }
+
+            // the row leaves the cache before suspending and the indexes once its write completed,
+            // a failed write leaves it in place as it is on disk. removing the last row cuts it
+            // off the storage, which is done synchronously.
+            auto async_remove(row_type& Row)
+            {
+                auto Start = [this, &Row, Key = Row.Entry.pk()](auto Complete)
+                    {
+                        if constexpr (async_storage)
+                        {
+                            storage.async_update(*AsyncRing, Row, [this, Key, Complete](row_type const& Row, bool Failed) mutable
+                                {
+                                    if (Failed)
+                                    {
+                                        mz::ErrLog << std::format("db_table[{}]::async_remove({}) corrupted\n", Name, Key.string());
+                                        Row.Index = -2;
+                                    }
+                                    else if (auto it = keys.find(Key); it != keys.end())
+                                    {
+                                        Cache.erase(Row.Index);
+                                        keys.erase(it);
+                                        for (auto& Index : Secondary) {
+                                            Index->erase(Row.Index);
+                                        }
+                                        FreeRows.push_back(Row.Index);
+                                        compact_remove(Row, false);
+                                    }
+                                    Complete(Failed);
+                                });
+                        }
+                    };
+                using awaitable = db_awaitable<decltype(Start)>;
+
+                if (!async_ready()) {
+                    return awaitable{ remove(Row) };
+                }
+                auto it = select_key(Row);
+                if (it == keys.end())
+                {
+                    db_events::post(db_event::async_remove_not_found, Name, Row.Entry.pk());
+                    Row.Index = -1;
+                    return awaitable{ true };
+                }
+                if (Row.Index + 1 == next_row()) {
+                    return awaitable{ remove(Row) };
+                }
+
+                Row.Entry.erase();
+                invalidate_sidecar(Row.Index);
+                Cache.erase(Row.Index);
+                return awaitable{ std::move(Start), &AsyncResume };
+            }
+
+
+
+
+            int open(std::filesystem::path const& Folder)
+            {
+                //DataMsg.clear();
+                compact_abort();
+                Path = Folder / Name;
+                SidecarRows = db_index_sidecar::rows(sidecar_path());
+                ExpireCursor = 0;
+                ExpiredPrefix = 0;
+                Cache.resize(Cache.capacity());
+                if (int Res = storage.open(Path, MaxRows); Res)
+                {
+                    //DataMsg = std::format("db_table[{}]::open: storage.open return with errors\n{}", Name, storage.ErrMsg);
+                    //fmt::print("{}\n", DataMsg);
+                    return Res;
+                }
+                ExpiredPrefix = dropped_rows();
+                return replay_log();
+            }
+
+
+
+
+
+
+
+            // online compaction: the live rows are copied into Path + ".compact" in bounded
+            // steps while the table keeps serving requests, a new index over the copy is
+            // built as it goes and both are swapped in once the copy caught up.
+            // rows already copied are written to both files by update/remove, rows appended
+            // meanwhile are picked up by later steps, freed rows are not reused until the swap.
+
+            bool compacting() const noexcept { return Compaction != nullptr; }
+
+            int compact_begin()
+            {
+                if (Compaction) {
+                    mz::ErrLog << std::format("db_table[{}]::compact_begin() already compacting\n", Name);
+                    return 7001;
+                }
+
+                auto State = std::make_unique<compaction>();
+                State->TempPath = Path;
+                State->TempPath += ".compact";
+
+                std::error_code Error;
+                remove_storage(State->TempPath, Error);
+                if constexpr (requires { storage.segment_rows(); }) {
+                    State->Target.SegmentRows = storage.segment_rows();
+                }
+                if (int Res = State->Target.open(State->TempPath, MaxRows); Res)
+                {
+                    mz::ErrLog << std::format("db_table[{}]::compact_begin() target open error {}\n", Name, Res);
+                    return 7002;
+                }
+                State->Keys.reserve(size_t(storage.count()) - FreeRows.size());
+                State->Remap.reserve(storage.count());
+                State->Remap.resize(size_t(ExpiredPrefix), -1);     // erased or dropped
+                Compaction = std::move(State);
+                return 0;
+            }
+
+
+            // copies up to Rows rows, swaps the files in once all rows are copied.
+            int compact_step(int64_t Rows)
+            {
+                if (!Compaction) {
+                    return 0;
+                }
+
+                auto& State = *Compaction;
+                row_type Row;
+                for (; Rows > 0 && State.cursor() < storage.count(); --Rows)
+                {
+                    Row.Index = State.cursor();
+                    if (storage.select(Row))
+                    {
+                        mz::ErrLog << std::format("db_table[{}]::compact_step() select({}) error\n", Name, State.cursor());
+                        compact_abort();
+                        return 7003;
+                    }
+
+                    if (Row.Entry.erased()) {
+                        State.Remap.push_back(-1);
+                        continue;
+                    }
+
+                    Row.Index = State.Target.count();
+                    if (State.Target.insert(Row) || !State.Keys.insert(Row.Entry.pk(), Row.Index).second)
+                    {
+                        mz::ErrLog << std::format("db_table[{}]::compact_step() insert({}) error\n", Name, Row.Entry.pk().string());
+                        compact_abort();
+                        return 7004;
+                    }
+                    State.Remap.push_back(Row.Index);
+                }
+
+                if (State.cursor() < storage.count()) {
+                    return 0;
+                }
+                return compact_swap();
+            }
+
+
+            // runs compaction steps of Chunk rows until Slice has elapsed or it completes.
+            int compact(mz::db::db_duration Slice, int64_t Chunk = 4096)
+            {
+                auto Start = std::chrono::steady_clock::now();
+                do {
+                    if (int Res = compact_step(Chunk); Res) {
+                        return Res;
+                    }
+                } while (Compaction && std::chrono::steady_clock::now() - Start < Slice);
+                return 0;
+            }
+
+
+            void compact_abort() noexcept
+            {
+                if (Compaction)
+                {
+                    Compaction->Target.close();
+                    std::error_code Error;
+                    remove_storage(Compaction->TempPath, Error);
+                    Compaction.reset();
+                }
+            }
+
+
+
+
+            void expire_after(mz::db::db_duration TTL) { TimeToLive = TTL; ExpireAt = nullptr; }
+            void expire_at(std::function<mz::db::db_time(entry_type const&)> Func) { ExpireAt = std::move(Func); }
+            bool expiring() const noexcept { return ExpireAt || TimeToLive.count() > 0; }
+
+            bool expired(entry_type const& Entry, mz::db::db_time Now) const
+            {
+                if (ExpireAt) {
+                    return !(Now.tsep < ExpireAt(Entry).tsep);
+                }
+                if constexpr (requires { Entry.pk().time(); }) {
+                    return TimeToLive.count() > 0 && Entry.pk().time().tsep + TimeToLive.count() <= Now.tsep;
+                }
+                return false;
+            }
+
+
+            // removes up to Rows expired rows, continuing where the last step stopped and
+            // wrapping around at the end of the table, meant to be called periodically
+            // from the thread that owns the table.
+            // a monotone index keyed by time holds the expired rows as a prefix, it is
+            // tombstoned a block at a time instead of row by row and no rows are swept.
+            int expire_step(mz::db::db_time Now, int64_t Rows)
+            {
+                if (!expiring() || Rows <= 0) {
+                    return 0;
+                }
+
+                if constexpr (map_type::monotone && std::constructible_from<key_type, mz::db::db_time>)
+                {
+                    if (!ExpireAt && !Compaction) {
+                        return expire_prefix(Now, Rows);
+                    }
+                }
+
+                if (ExpireCursor < ExpiredPrefix || ExpireCursor >= storage.count()) {
+                    ExpireCursor = ExpiredPrefix;
+                }
+
+                std::vector<entry_type> Block(size_t(std::min<int64_t>(Rows, int64_t(LoadBlock))));
+                row_type Row;
+                while (Rows > 0 && ExpireCursor < storage.count())
+                {
+                    size_t Count = size_t(std::min<int64_t>({ Rows, int64_t(Block.size()), storage.count() - ExpireCursor }));
+                    if (storage.select_range(ExpireCursor, Block.data(), Count))
+                    {
+                        mz::ErrLog << std::format("db_table[{}]::expire_step:storage::select_range({}) file error: {}\n", Name, ExpireCursor, storage.report_errors());
+                        return 9001;
+                    }
+
+                    int64_t First = ExpireCursor;
+                    ExpireCursor += int64_t(Count);
+                    Rows -= int64_t(Count);
+                    for (size_t i = 0; i < Count && First + int64_t(i) < storage.count(); ++i)
+                    {
+                        if (Block[i].erased() || !expired(Block[i], Now)) {
+                            continue;
+                        }
+                        Row.Index = First + int64_t(i);
+                        Row.Entry = Block[i];
+                        if (remove(Row)) {
+                            return 9002;
+                        }
+                        ++Expired;
+                    }
+                }
+                return 0;
+            }
+
+            // runs expire_step over Chunk rows until Slice has elapsed or a full pass is done
+            int expire(mz::db::db_time Now, mz::db::db_duration Slice, int64_t Chunk = 4096)
+            {
+                auto Start = std::chrono::steady_clock::now();
+                for (int64_t Swept = 0; Swept < storage.count(); Swept += Chunk)
+                {
+                    if (int Res = expire_step(Now, Chunk); Res) {
+                        return Res;
+                    }
+                    if (std::chrono::steady_clock::now() - Start >= Slice) {
+                        break;
+                    }
+                }
+                return 0;
+            }
+
+
+            // drops the segments of a db_table_segmented whose rows all lie in the expired
+            // prefix, deleting their files or moving them into the folder Archive. the write
+            // log is checkpointed first, it may hold rows of them. the dropped rows keep
+            // their erased keys in a monotone index, load() gives them placeholder keys.
+            int drop_segments(std::filesystem::path const& Archive = {})
+                requires (requires (storage_type& Storage) { Storage.drop_segment(std::filesystem::path{}); })
+            {
+                if (Compaction)
+                {
+                    mz::ErrLog << std::format("db_table[{}]::drop_segments() compacting\n", Name);
+                    return 11001;
+                }
+                if (int Res = checkpoint_log(); Res) {
+                    return Res;
+                }
+
+                int64_t Rows = int64_t(storage.segment_rows());
+                while (dropped_rows() + Rows <= ExpiredPrefix && dropped_rows() + Rows < storage.count())
+                {
+                    if (storage.drop_segment(Archive))
+                    {
+                        mz::ErrLog << std::format("db_table[{}]::drop_segments() error: {}\n", Name, storage.report_errors());
+                        return 11002;
+                    }
+                }
+                std::erase_if(FreeRows, [&](int64_t Row) { return Row < dropped_rows(); });
+                return 0;
+            }
+
+            // rows [0, dropped_rows()) went with the segments drop_segments() dropped
+            int64_t dropped_rows() const noexcept
+            {
+                if constexpr (requires { storage.first_index(); }) {
+                    return storage.first_index();
+                }
+                return 0;
+            }
+
+
+            // appends Rows as new rows in one go, all or none. the keys have to ascend and be
+            // new, they are checked once and added with one insert_sorted(), a vector append
+            // for a monotone index, then the entries are written with one insert_range() of
+            // the storage. erased rows are not reused. sets Row.Index of every row, -1 when
+            // nothing was inserted, count() is then as it was before.
+            int insert_bulk(std::span<row_type> Rows)
+            {
+                if (Rows.empty()) {
+                    return 0;
+                }
+                auto Fail = [&](int Res)
+                    {
+                        for (auto& Row : Rows) {
+                            Row.Index = -1;
+                        }
+                        return Res;
+                    };
+
+                int64_t First = storage.count();
+                std::vector<pair_type> Pairs;
+                Pairs.reserve(Rows.size());
+                for (size_t i = 0; i < Rows.size(); ++i)
+                {
+                    key_type Key = Rows[i].Entry.pk();
+                    if (i && !(Pairs.back().first.upper() < Key.lower()))
+                    {
+                        mz::ErrLog << std::format("db_table[{}]::insert_bulk() key {} of row {} out of order\n", Name, Key.string(), i);
+                        return Fail(12001);
+                    }
+                    Pairs.emplace_back(Key, First + int64_t(i));
+                }
+                if constexpr (map_type::monotone)
+                {
+                    if (int64_t(keys.size()) != First || keys.lower_bound(Pairs.front().first) != keys.end())
+                    {
+                        mz::ErrLog << std::format("db_table[{}]::insert_bulk() key {} not after the last key\n", Name, Pairs.front().first.string());
+                        return Fail(12001);
+                    }
+                }
+                if (keys.insert_sorted(std::span<pair_type const>{ Pairs }, false))
+                {
+                    mz::ErrLog << std::format("db_table[{}]::insert_bulk() a key exists\n", Name);
+                    return Fail(12001);
+                }
+
+                // in reverse so a monotone index pops its last key every time
+                auto Unwind = [&](size_t Indexed)
+                    {
+                        for (size_t i = Indexed; i-- > 0;)
+                        {
+                            for (auto& Other : Secondary) {
+                                Other->erase(Pairs[i].second);
+                            }
+                        }
+                        for (size_t i = Pairs.size(); i-- > 0;)
+                        {
+                            if (auto it = keys.find(Pairs[i].first); it != keys.end()) {
+                                keys.pop(it);
+                            }
+                        }
+                    };
+
+                for (size_t i = 0; i < Rows.size(); ++i)
+                {
+                    Rows[i].Index = Pairs[i].second;
+                    if (secondary_conflict(Rows[i].Entry, -1))
+                    {
+                        mz::ErrLog << std::format("db_table[{}]::insert_bulk({}) secondary key exists\n", Name, Pairs[i].first.string());
+                        Unwind(i);
+                        return Fail(12002);
+                    }
+                    secondary_insert(Rows[i]);
+                }
+
+                bool Failed{ false };
+                if constexpr (requires (entry_type const* Entries) { storage.insert_range(First, Entries, Rows.size()); })
+                {
+                    std::vector<entry_type> Entries;
+                    Entries.reserve(Rows.size());
+                    for (auto& Row : Rows) {
+                        Entries.push_back(Row.Entry);
+                    }
+                    Failed = storage.insert_range(First, Entries.data(), Entries.size());
+                }
+                else
+                {
+                    for (auto& Row : Rows)
+                    {
+                        if (storage.insert(Row))
+                        {
+                            Failed = true;
+                            break;
+                        }
+                    }
+                    while (Failed && storage.count() > First) {
+                        storage.pop();
+                    }
+                }
+                if (Failed)
+                {
+                    mz::ErrLog << std::format("db_table[{}]::insert_bulk({} rows) storage error: {}\n", Name, Rows.size(), storage.report_errors());
+                    Unwind(Rows.size());
+                    return Fail(12003);
+                }
+                return 0;
+            }
+
+
+
+        protected:
+
+
+            // tombstones up to Rows rows of the expired prefix of a monotone index with block
+            // reads and writes. the rows are not added to FreeRows, a monotone index can not
+            // reuse them for new keys, compaction reclaims them.
+            int expire_prefix(mz::db::db_time Now, int64_t Rows)
+                requires (map_type::monotone)
+            {
+                key_type Cut{ mz::db::db_time{ Now.tsep - TimeToLive.count() + 1 } };
+                int64_t End = std::min<int64_t>(int64_t(keys.lower_bound(Cut) - keys.begin()), storage.count());
+                End = std::min(End, ExpiredPrefix + Rows);
+                if (End <= ExpiredPrefix) {
+                    return 0;
+                }
+
+                invalidate_sidecar(ExpiredPrefix);
+                std::vector<entry_type> Block(size_t(std::min<int64_t>(End - ExpiredPrefix, int64_t(LoadBlock))));
+                while (ExpiredPrefix < End)
+                {
+                    size_t Count = size_t(std::min<int64_t>(int64_t(Block.size()), End - ExpiredPrefix));
+                    if (storage.select_range(ExpiredPrefix, Block.data(), Count))
+                    {
+                        mz::ErrLog << std::format("db_table[{}]::expire_prefix:storage::select_range({}) file error: {}\n", Name, ExpiredPrefix, storage.report_errors());
+                        return 9001;
+                    }
+
+                    size_t Live{ 0 };
+                    for (size_t i = 0; i < Count; ++i)
+                    {
+                        if (Block[i].erased()) {
+                            continue;
+                        }
+                        int64_t Index = ExpiredPrefix + int64_t(i);
+                        Block[i].erase();
+                        Cache.erase(Index);
+                        keys.tombstone(keys.begin() + Index);
+                        for (auto& Other : Secondary) {
+                            Other->erase(Index);
+                        }
+                        ++Live;
+                    }
+
+                    if (Live && storage.update_range(ExpiredPrefix, Block.data(), Count))
+                    {
+                        mz::ErrLog << std::format("db_table[{}]::expire_prefix:storage::update_range({}) file error: {}\n", Name, ExpiredPrefix, storage.report_errors());
+                        return 9002;
+                    }
+                    Expired += int64_t(Live);
+                    ExpiredPrefix += int64_t(Count);
+                }
+                return 0;
+            }
+
+
+
+            // rows per block of select_where and modify_where
+            static constexpr size_t scan_block() noexcept { return std::max<size_t>(1, ScanBytes / sizeof(entry_type)); }
+
+            // first block holding a row not dropped by expire_prefix
+            int64_t scan_first(size_t BlockRows) const noexcept { return ExpiredPrefix - ExpiredPrefix % int64_t(BlockRows); }
+
+            int scan_where(auto const& Pred, auto&& Visit)
+            {
+                size_t BlockRows = scan_block();
+                std::vector<entry_type> Block;
+                std::vector<uint64_t> Mask;
+                for (int64_t Base = scan_first(BlockRows); Base < storage.count(); Base += int64_t(BlockRows))
+                {
+                    size_t Count = size_t(std::min<int64_t>(int64_t(BlockRows), storage.count() - Base));
+                    std::span<entry_type const> View;
+                    if constexpr (requires { storage.view_range(Base, Count); }) {
+                        View = storage.view_range(Base, Count);
+                    }
+                    else
+                    {
+                        Block.resize(Count);
+                        if (!storage.select_range(Base, Block.data(), Count)) {
+                            View = std::span<entry_type const>{ Block.data(), Count };
+                        }
+                    }
+                    if (View.empty())
+                    {
+                        mz::ErrLog << std::format("db_table[{}]::select_where:storage::select_range({}) file error: {}\n", Name, Base, storage.report_errors());
+                        return 5000;
+                    }
+
+                    db_match(Pred, View, Mask);
+                    db_for_each_bit(Mask, [&](size_t i)
+                        {
+                            if (!View[i].erased()) {
+                                Visit(Base, View, i);
+                            }
+                        });
+                }
+                return 0;
+            }
+
+
+
+            using pair_type = typename map_type::pair_type;
+
+            // rows [First, Last) of a load_parallel worker
+            struct load_part
+            {
+                size_t First{ 0 };
+                size_t Last{ 0 };
+                std::vector<pair_type> Keys;
+                std::vector<int64_t> Free;
+                int Res{ 0 };
+                int64_t Failed{ -1 };
+            };
+
+            void load_worker(load_part& Part, auto& Func, bool Callback) const
+            {
+                std::vector<entry_type> Block(std::min(LoadBlock, Part.Last - Part.First));
+                Part.Keys.reserve(Part.Last - Part.First);
+                row_type Row;
+                for (size_t First = Part.First; First < Part.Last; First += Block.size())
+                {
+                    size_t Count = std::min(Block.size(), Part.Last - First);
+                    if (storage.select_range(int64_t(First), Block.data(), Count))
+                    {
+                        Part.Res = 5000;
+                        Part.Failed = int64_t(First);
+                        return;
+                    }
+
+                    for (size_t i = 0; i < Count; ++i)
+                    {
+                        Row.Index = int64_t(First + i);
+                        Row.Entry = Block[i];
+                        if (Row.Entry.erased()) {
+                            Part.Free.push_back(Row.Index);
+                        }
+                        if (map_type::monotone || !Row.Entry.erased())
+                        {
+                            if (map_type::monotone && !Part.Keys.empty() && !(Part.Keys.back().first.upper() < Row.Entry.pk().lower()))
+                            {
+                                Part.Res = 6000;
+                                Part.Failed = Row.Index;
+                                return;
+                            }
+                            Part.Keys.emplace_back(Row.Entry.pk(), Row.Index);
+                        }
+                        if (Callback)
+                        {
+                            if (int Res = Func(Row); Res) {
+                                Part.Res = Res;
+                                Part.Failed = Row.Index;
+                                return;
+                            }
+                        }
+                    }
+                }
+
+                if constexpr (!map_type::monotone) {
+                    std::sort(Part.Keys.begin(), Part.Keys.end(), [](pair_type const& L, pair_type const& R) noexcept { return L.first < R.first; });
+                }
+            }
+
+
+            // joins the sorted keys of every part and hands them to the index at once
+            int load_merge(std::vector<load_part>& Parts)
+            {
+                auto Before = [](pair_type const& L, pair_type const& R) noexcept { return L.first < R.first; };
+                auto Same = [](pair_type const& L, pair_type const& R) noexcept { return L.first == R.first; };
+
+                std::vector<std::vector<pair_type>> Runs;
+                for (auto& Part : Parts) {
+                    Runs.push_back(std::move(Part.Keys));
+                }
+
+                while (Runs.size() > 1)
+                {
+                    std::vector<std::vector<pair_type>> Merged((Runs.size() + 1) / 2);
+                    {
+                        std::vector<std::jthread> Workers;
+                        for (size_t i = 0; i < Merged.size(); ++i)
+                        {
+                            Workers.emplace_back([&, i]
+                                {
+                                    auto& L = Runs[2 * i];
+                                    if (2 * i + 1 == Runs.size()) {
+                                        Merged[i] = std::move(L);
+                                        return;
+                                    }
+                                    auto& R = Runs[2 * i + 1];
+                                    Merged[i].resize(L.size() + R.size());
+                                    if constexpr (map_type::monotone) {
+                                        std::copy(R.begin(), R.end(), std::copy(L.begin(), L.end(), Merged[i].begin()));
+                                    }
+                                    else {
+                                        std::merge(L.begin(), L.end(), R.begin(), R.end(), Merged[i].begin(), Before);
+                                    }
+                                    std::vector<pair_type>().swap(L);
+                                    std::vector<pair_type>().swap(R);
+                                });
+                        }
+                    }
+                    Runs.swap(Merged);
+                }
+
+                auto& All = Runs[0];
+                auto Dup = std::adjacent_find(All.begin(), All.end(), [&](pair_type const& L, pair_type const& R) noexcept { return Same(L, R) || !Before(L, R); });
+                if (Dup != All.end())
+                {
+                    mz::ErrLog << std::format("db_table[{}]::load_parallel:index_map::insert({}) duplicate.\n", Name, std::next(Dup)->second);
+                    return 6000;
+                }
+                if (keys.insert_sorted(std::span<pair_type const>{ All }, false))
+                {
+                    mz::ErrLog << std::format("db_table[{}]::load_parallel:index_map::insert_sorted({}) failed.\n", Name, All.size());
+                    return 6000;
+                }
+                return 0;
+            }
+
+
+            bool secondary_conflict(entry_type const& Entry, int64_t Index) const
+            {
+                for (auto& Other : Secondary) {
+                    if (Other->conflicts(Entry, Index)) { return true; }
+                }
+                return false;
+            }
+
+            void secondary_insert(row_type const& Row)
+            {
+                for (auto& Index : Secondary) {
+                    Index->insert(Row.Entry, Row.Index);
+                }
+            }
+
+            // clears Secondary[From...] and indexes every live row into them
+            int index_rows(size_t From)
+            {
+                if (From >= Secondary.size()) {
+                    return 0;
+                }
+                for (size_t i = From; i < Secondary.size(); ++i) {
+                    Secondary[i]->clear();
+                }
+
+                // rows of the expired prefix are erased
+                size_t Rows = size_t(storage.count());
+                std::vector<entry_type> Block(std::min(LoadBlock, std::max<size_t>(Rows, 1)));
+                for (size_t First = size_t(ExpiredPrefix); First < Rows; First += Block.size())
+                {
+                    size_t Count = std::min(Block.size(), Rows - First);
+                    if (storage.select_range(int64_t(First), Block.data(), Count))
+                    {
+                        mz::ErrLog << std::format("db_table[{}]::index_rows:storage::select_range({}) file error: {}\n", Name, First, storage.report_errors());
+                        return 5000;
+                    }
+                    for (size_t i = 0; i < Count; ++i)
+                    {
+                        if (Block[i].erased()) {
+                            continue;
+                        }
+                        for (size_t j = From; j < Secondary.size(); ++j)
+                        {
+                            if (Secondary[j]->insert(Block[i], int64_t(First + i)))
+                            {
+                                mz::ErrLog << std::format("db_table[{}]::index_rows:{}::insert({}) duplicate.\n", Name, Secondary[j]->Name, First + i);
+                                return 6001;
+                            }
+                        }
+                    }
+                }
+                return 0;
+            }
+
+            // removes the sidecar before row Index, which it covers, changes its key
+            void invalidate_sidecar(int64_t Index) noexcept
+            {
+                if (Index < SidecarRows)
+                {
+                    db_index_sidecar::remove(sidecar_path());
+                    SidecarRows = -1;
+                }
+            }
+
+            // bytes of the data file, recorded in the sidecar: a file shorter at load than at the
+            // checkpoint was cut since. a storage that preallocates, db_table_mmap, has no
+            // file_size() and is taken to hold its rows only, the rows it counts at open().
+            int64_t storage_bytes() const noexcept
+            {
+                if constexpr (requires { storage.file_size(); }) {
+                    return storage.file_size();
+                }
+                return storage.count() * int64_t(sizeof(entry_type));
+            }
+
+            // checksum of the key of row Index, 0 for no row
+            uint64_t row_stamp(int64_t Index) const
+            {
+                row_type Row;
+                Row.Index = Index;
+                if (Index < 0 || Index >= storage.count() || storage.select(Row)) {
+                    return 0;
+                }
+                key_type Key = Row.Entry.pk().lower();
+                return db_checksum(&Key, sizeof(Key));
+            }
+
+            // a monotone index maps keys to rows by position, the rows of dropped segments get
+            // erased keys counting down from the key of the first row kept. returns the first
+            // row to load, -1 when it can not be read.
+            int64_t index_dropped()
+            {
+                int64_t First = dropped_rows();
+                if constexpr (map_type::monotone)
+                {
+                    row_type Row;
+                    Row.Index = First;
+                    if (First && storage.select(Row))
+                    {
+                        mz::ErrLog << std::format("db_table[{}]::load:storage::select({}) file error: {}\n", Name, First, storage.report_errors());
+                        return -1;
+                    }
+                    std::vector<pair_type> Pairs(static_cast<size_t>(First));
+                    key_type Key = Row.Entry.pk();
+                    for (int64_t i = First; i-- > 0;)
+                    {
+                        Key = Key.lower().prev();
+                        Key.erase();
+                        Pairs[size_t(i)] = pair_type{ Key, i };
+                    }
+                    keys.insert_sorted(std::span<pair_type const>{ Pairs }, false);
+                }
+                return First;
+            }
+
+            // a storage engine keeping a table in several files removes and renames them itself
+            static void remove_storage(std::filesystem::path const& Target, std::error_code& Error)
+            {
+                if constexpr (requires { storage_type::remove(Target, Error); }) {
+                    storage_type::remove(Target, Error);
+                }
+                else {
+                    std::filesystem::remove(Target, Error);
+                }
+            }
+
+            static void rename_storage(std::filesystem::path const& From, std::filesystem::path const& To, std::error_code& Error)
+            {
+                if constexpr (requires { storage_type::rename(From, To, Error); }) {
+                    storage_type::rename(From, To, Error);
+                }
+                else {
+                    std::filesystem::rename(From, To, Error);
+                }
+            }
+
+            // restores keys and FreeRows from a sidecar that matches the data file,
+            // returns the number of rows it covers or 0 after removing a stale one.
+            int64_t load_sidecar()
+            {
+                if (SidecarRows < 0) {
+                    return 0;
+                }
+
+                std::vector<pair_type> Pairs;
+                db_index_sidecar::header Header{};
+                if (db_index_sidecar::read(sidecar_path(), Pairs, FreeRows, Header)
+                    || Header.Rows > storage.count()
+                    || Header.FileSize < Header.Rows * int64_t(sizeof(entry_type))
+                    || storage_bytes() < Header.FileSize
+                    || Header.LastRow != row_stamp(Header.Rows - 1)
+                    || keys.insert_sorted(std::span<pair_type const>{ Pairs }, false))
+                {
+                    mz::ErrLog << std::format("db_table[{}]::load() stale index sidecar, scanning {} rows\n", Name, storage.count());
+                    keys.clear();
+                    FreeRows.clear();
+                    db_index_sidecar::remove(sidecar_path());
+                    SidecarRows = -1;
+                    return 0;
+                }
+                SidecarRows = Header.Rows;
+                return Header.Rows;
+            }
+
+
+            struct compaction
+            {
+                std::filesystem::path TempPath;
+                storage_type Target;
+                map_type Keys;
+                std::vector<int64_t> Remap;     // old row -> new row, -1 when not copied
+                std::vector<int64_t> FreeRows;  // rows of Target erased after they were copied
+
+                int64_t cursor() const noexcept { return int64_t(Remap.size()); }
+                int64_t target(int64_t Index) const noexcept { return Index < cursor() ? Remap[Index] : -1; }
+            };
+
+            std::unique_ptr<compaction> Compaction;
+
+
+            void compact_update(row_type const& Row)
+            {
+                if (!Compaction) {
+                    return;
+                }
+                if (int64_t Index = Compaction->target(Row.Index); Index >= 0)
+                {
+                    row_type Copy{ Index, Row.Entry };
+                    if (Compaction->Target.update(Copy))
+                    {
+                        mz::ErrLog << std::format("db_table[{}]::compact_update({}) error\n", Name, Row.Index);
+                        compact_abort();
+                    }
+                }
+            }
+
+            // Popped: the row was cut off the end of storage, its index will be handed out again.
+            void compact_remove(row_type const& Row, bool Popped)
+            {
+                if (!Compaction) {
+                    return;
+                }
+                auto& State = *Compaction;
+                if (int64_t Index = State.target(Row.Index); Index >= 0)
+                {
+                    row_type Copy{ Index, Row.Entry };
+                    Copy.Entry.erase();
+                    auto it = State.Keys.find(Row.Entry.pk());
+                    if (it == State.Keys.end() || (Index + 1 != State.Target.count() && State.Target.update(Copy)))
+                    {
+                        mz::ErrLog << std::format("db_table[{}]::compact_remove({}) error\n", Name, Row.Index);
+                        compact_abort();
+                        return;
+                    }
+
+                    if (Index + 1 == State.Target.count()) {
+                        State.Target.pop();
+                    }
+                    else {
+                        State.FreeRows.push_back(Index);
+                    }
+                    State.Keys.erase(it);
+                    State.Remap[Row.Index] = -1;
+                }
+                if (Popped && Row.Index + 1 == State.cursor()) {
+                    State.Remap.pop_back();
+                }
+            }
+
+
+            int compact_swap()
+            {
+                // the log refers to rows by their place in the old file
+                if (int Res = checkpoint_log(); Res)
+                {
+                    compact_abort();
+                    return Res;
+                }
+
+                auto State = std::move(Compaction);
+                State->Target.sync();
+                State->Target.close();
+                storage.close();
+
+                invalidate_sidecar(0);
+                std::error_code Error;
+                rename_storage(State->TempPath, Path, Error);
+                if (Error) {
+                    mz::ErrLog << std::format("db_table[{}]::compact_swap() rename error {}\n", Name, Error.message());
+                    remove_storage(State->TempPath, Error);
+                }
+                else {
+                    keys = std::move(State->Keys);
+                    FreeRows = std::move(State->FreeRows);
+                    for (auto& Index : Secondary) {
+                        Index->remap(std::span<int64_t const>{ State->Remap });
+                    }
+                    ExpireCursor = 0;
+                    ExpiredPrefix = 0;
+                }
+                Cache.resize(Cache.capacity());
+
+                if (int Res = storage.open(Path, MaxRows); Res)
+                {
+                    mz::ErrLog << std::format("db_table[{}]::compact_swap() reopen error {}\n", Name, Res);
+                    return 7005;
+                }
+                return Error ? 7006 : 0;
+            }
+
+
+
+
+            static constexpr bool async_storage = requires (storage_type& Storage, db_io_ring& Ring, row_type& Row) {
+                Storage.async_select(Ring, Row, [](row_type&, bool) {});
+                Storage.next_index();
+            };
+
+            // row the next insert appends, rows of async inserts in flight included
+            int64_t next_row() const noexcept
+            {
+                if constexpr (async_storage) {
+                    return storage.next_index();
+                }
+                return storage.count();
+            }
+
+            // true when the async_ calls go through AsyncRing
+            bool async_ready() const noexcept { return async_storage && AsyncRing; }
+
+            // insert through AsyncRing, the key is indexed before suspending so a second insert
+            // of it fails at once. a reused free row is written with async_update, an appended
+            // one with async_insert, it is found by select once the insert completed. a reused
+            // row whose write failed goes back to FreeRows.
+            auto async_insert(row_type& Row)
+            {
+                auto Start = [this, &Row](auto Complete)
+                    {
+                        bool Reused = Row.Index < storage.count();
+                        auto Done = [this, &Row, Complete, Reused, Index = Row.Index](auto&&, bool Failed) mutable
+                            {
+                                if (Failed)
+                                {
+                                    mz::ErrLog << std::format("db_table::async_insert({}) corrupted\n", Row.Entry.pk().string());
+                                    if (auto it = keys.find(Row.Entry.pk()); it != keys.end()) {
+                                        keys.erase(it);
+                                    }
+                                    if (Reused) {
+                                        FreeRows.push_back(Index);
+                                    }
+                                    Row.Index = -2;
+                                }
+                                else {
+                                    secondary_insert(Row);
+                                }
+                                Complete(Failed);
+                            };
+                        if constexpr (async_storage)
+                        {
+                            if (Reused) {
+                                storage.async_update(*AsyncRing, Row, std::move(Done));
+                            }
+                            else {
+                                storage.async_insert(*AsyncRing, Row, std::move(Done));
+                            }
+                        }
+                    };
+                using awaitable = db_awaitable<decltype(Start)>;
+
+                if (!async_ready()) {
+                    return awaitable{ insert(Row) };
+                }
+                if (secondary_conflict(Row.Entry, -1))
+                {
+                    mz::ErrLog << std::format("db_table::async_insert({}) secondary key exists\n", Row.Entry.pk().string());
+                    Row.Index = -1;
+                    return awaitable{ true };
+                }
+
+                bool Reuse = !FreeRows.empty() && FreeRows.back() < storage.count() && !Compaction;
+                Row.Index = Reuse ? FreeRows.back() : next_row();
+                auto [it, success] = keys.insert(Row.Entry.pk(), Row.Index);
+                if (!success)
+                {
+                    mz::ErrLog << std::format("db_table::async_insert({}) failed\n", Row.Entry.pk().string());
+                    Row.Index = -1;
+                    return awaitable{ true };
+                }
+                if (Reuse)
+                {
+                    invalidate_sidecar(Row.Index);
+                    Cache.erase(Row.Index);
+                    FreeRows.pop_back();
+                }
+                return awaitable{ std::move(Start), &AsyncResume };
+            }
+
+
+            bool insert(row_type& Row)
+            {
+                db_op_timer Timer{ Stats, db_op::insert };
+                if (secondary_conflict(Row.Entry, -1))
+                {
+                    mz::ErrLog << std::format("db_table::insert({}) secondary key exists\n", Row.Entry.pk().string());
+                    Row.Index = -1;
+                    return true;
+                }
+
+                if (!FreeRows.empty() && FreeRows.back() < storage.count() && !Compaction)
+                {
+                    Row.Index = FreeRows.back();
+                    invalidate_sidecar(Row.Index);
+                    Cache.erase(Row.Index);
+                    auto [it, success] = keys.insert(Row.Entry.pk(), Row.Index);
+                    if (success)
+                    {
+                        if (storage.update(Row))
+                        {
+                            mz::ErrLog << std::format("db_table::insert({}) corrupted\n", Row.Entry.pk().string());
+                            keys.pop(it);
+                            Row.Index = -2;
+                            return true;
+                        }
+                        FreeRows.pop_back();
+                        secondary_insert(Row);
+                        return false;
+                    }
+                }
+
+                Row.Index = storage.count();
+                auto [it, success] = keys.insert(Row.Entry.pk(), Row.Index);
+                if (!success) {
+                    mz::ErrLog << std::format("db_table::insert({}) failed\n", Row.Entry.pk().string());
+                    Row.Index = -1;
+                    return true;
+                }
+                if (storage.insert(Row))
+                {
+                    mz::ErrLog << std::format("db_table::insert({}) corrupted\n", Row.Entry.pk().string());
+                    keys.pop(it);
+                    Row.Index = -2;
+                    return true;
+                }
+
+                secondary_insert(Row);
+                return false;
+            }
+
+
+            // writes the batches a crash left in the write log to the storage again
+            int replay_log()
+            {
+                auto LogPath = db_write_log<entry_type>::path_of(Path);
+                std::error_code Error;
+                if (!std::filesystem::exists(LogPath, Error))
+                {
+                    Log.close();
+                    Unapplied = false;
+                    return 0;
+                }
+
+                int64_t Replayed{ 0 };
+                auto Apply = [&](typename db_write_log<entry_type>::record const& Record) -> bool
+                    {
+                        row_type Row{ Record.Index, Record.Entry };
+                        invalidate_sidecar(Row.Index);
+                        ++Replayed;
+                        if (Row.Index < storage.count()) {
+                            return storage.update(Row);
+                        }
+                        return Row.Index != storage.count() || storage.insert(Row);
+                    };
+                if (Log.open(LogPath, Apply))
+                {
+                    mz::ErrLog << std::format("db_table[{}]::open() write log replay error at row {}\n", Name, Replayed);
+                    return 10001;
+                }
+                Unapplied = false;
+                if (Replayed) {
+                    mz::ErrLog << std::format("db_table[{}]::open() replayed {} rows from the write log\n", Name, Replayed);
+                }
+                return checkpoint_log();
             }
 
 
@@ -2,7 +2,12 @@
 #define DB_TABLE_FILE_TEMPLATE_HEADER_FILE
 #pragma once
 
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
 #include <string>
+#include <vector>
 #include <format>
 #include <filesystem>
 
@@ -10,6 +15,10 @@
 #include "multifile_io.h"
 #include "time_conversions.h"
 #include "db_concepts.h"
+#include "db_file_io.h"
+#include "db_io_ring.h"
+#include "db_stats.h"
+#include "db_events.h"
 #include "db_index_id.h"
 #include "db_index_lin.h"
 #include "db_index_map.h"
@@ -66,9 +75,36 @@ namespace mz {
                 return Res;
             }
 
+            // flags raised from concurrent readers are merged atomically,
+            // e.g. Errors.raise([](auto& E) { E.read = 1; });
+            void raise(auto&& Set) noexcept
+            {
+                db_table_errors Flags;
+                Flags.value = 0;
+                Set(Flags);
+                std::atomic_ref<uint32_t>(value).fetch_or(Flags.value, std::memory_order_relaxed);
+            }
+
+            uint32_t bits() noexcept { return std::atomic_ref<uint32_t>(value).load(std::memory_order_relaxed); }
+
         };
 
 
+        // durability of buffered inserts, see db_table_file::buffer_inserts
+        enum class db_sync_mode {
+            none,   // written in batches, flushed to disk by the OS
+            batch,  // fdatasync after every batch write
+            always, // every insert is written and synced before it returns
+        };
+
+
+        // select, update and insert use positional reads/writes at row_offset(Index)
+        // through Direct and share no cursor, so any number of threads may select and
+        // update rows concurrently, appends are serialized by AppendLock.
+        // File and its cursor are only used by open, the sequential *_next functions
+        // and generate_report.
+        // inserts can be buffered in Pending and written as one block, rows
+        // [Flushed, count()) live in Pending until then and are served from there.
         template <mz::db::EntryType T>
         class db_table_file
         {
@@ -81,11 +117,28 @@ namespace mz {
             using row_type = indexed_record<entry_type>;
 
             mz::io::file File;
+            mz::db::db_native_file Direct;
+            mutable std::mutex AppendLock;
             size_t MaxIndexes{ 0 };
-            size_t NumIndexes{ 0 };
+            std::atomic<size_t> NumIndexes{ 0 };
+            std::atomic<size_t> Flushed{ 0 };
+
+            std::vector<T> Pending{};
+            size_t FlushRows{ 0 };
+            mz::db::db_duration FlushDelay{ 0 };
+            mz::db::db_sync_mode SyncMode{ db_sync_mode::none };
+            std::chrono::steady_clock::time_point PendingSince{};
+
+            // rows [count(), count() + Landing.size()) handed out by async_insert, true once
+            // written. count() moves over a row when it and all rows before it are written.
+            std::deque<bool> Landing{};
 
             mutable mz::db::db_table_errors Errors;
             mutable std::string ErrMsg{};
+            std::string Source{};   // file name, names the storage in its events and messages
+
+            // bytes moved from and to the file, counted only when DB_TABLE_STATS is on
+            [[no_unique_address]] mz::db::db_io_counters IoStats{};
 
             std::string report_errors() const noexcept {
                 return std::format("{}", File.eflags().value);
@@ -93,34 +146,94 @@ namespace mz {
 
 
             constexpr size_t row_offset(size_t Index) const noexcept { return RecordSize * Index; }
-            constexpr int64_t count() const noexcept { return (int64_t)NumIndexes; }
-            constexpr int64_t last_index() const noexcept { return int64_t(NumIndexes) - 1; }
-            constexpr uint32_t nextIndex() const noexcept { return uint32_t(NumIndexes); }
-            constexpr bool bad() const noexcept { return Errors.value || File.bad(); }
-            constexpr bool fail() const noexcept { return Errors.value || File.fail(); }
-            constexpr bool good() const noexcept { return !Errors.value && File.good(); }
+            int64_t count() const noexcept { return (int64_t)NumIndexes.load(std::memory_order_acquire); }
+            int64_t last_index() const noexcept { return count() - 1; }
+            uint32_t nextIndex() const noexcept { return uint32_t(count()); }
+
+            // bytes of the data file on disk, -1 when it cannot be read. rows still in Pending
+            // are not in it, rows of async inserts in flight may be.
+            int64_t file_size() const noexcept { return Direct.size(); }
+            bool bad() const noexcept { return Errors.bits() || File.bad(); }
+            bool fail() const noexcept { return Errors.bits() || File.fail(); }
+            bool good() const noexcept { return !Errors.bits() && File.good(); }
 
 
 
             bool select(row_type& Row) const noexcept
             {
-                if (seekg_index(Row.Index) || select_next(Row.Entry))
+                if (!good(Row.Index) || read_at(Row.Index, Row.Entry))
                 {
-                    mz::ErrLog << std::format("select_entry(,{}) fail", Row.Index);
+                    db_events::post(db_event::storage_select_fail, Source, Row.Index);
                     Row.Index = -112;
                     return true;
                 }
                 return false;
             }
 
+            // reads rows [Index, Index + Count) into Entries, flushed rows with one positional read
+            bool select_range(int64_t Index, T* Entries, size_t Count) const noexcept
+            {
+                if (!Count) {
+                    return false;
+                }
+                if (Index < 0 || !good(size_t(Index) + Count - 1))
+                {
+                    db_events::post(db_event::storage_select_range_fail, Source, Index, int64_t(Count));
+                    return true;
+                }
+
+                size_t First = Flushed.load(std::memory_order_acquire);
+                size_t OnFile = size_t(Index) < First ? std::min(Count, First - size_t(Index)) : 0;
+                if (OnFile && Direct.read_at(Entries, RecordSize * OnFile, int64_t(row_offset(Index))))
+                {
+                    mz::ErrLog << std::format("select_range({},{}) Direct.read_at fail", Index, OnFile);
+                    Errors.raise([](auto& E) { E.read = 1; });
+                    return true;
+                }
+                IoStats.read(RecordSize * OnFile);
+                for (size_t i = OnFile; i < Count; ++i)
+                {
+                    if (read_at(Index + int64_t(i), Entries[i])) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
             bool update(row_type const& Row) noexcept
             {
-                if (seekp_index(Row.Index) || update_next(Row.Entry))
+                if (!good(Row.Index) || write_at(Row.Index, Row.Entry))
                 {
                     Row.Index = -113;
-                    mz::ErrLog << std::format("update_entry(,{}) fail", Row.Index);
+                    db_events::post(db_event::storage_update_fail, Source, Row.Index);
+                    return true;
+                }
+                return false;
+            }
+
+            // writes Entries over rows [Index, Index + Count), flushed rows with one positional write
+            bool update_range(int64_t Index, T const* Entries, size_t Count) noexcept
+            {
+                if (!Count) {
+                    return false;
+                }
+                if (Index < 0 || !good(size_t(Index) + Count - 1))
+                {
+                    db_events::post(db_event::storage_update_range_fail, Source, Index, int64_t(Count));
                     return true;
                 }
+
+                size_t First = Flushed.load(std::memory_order_acquire);
+                size_t OnFile = size_t(Index) < First ? std::min(Count, First - size_t(Index)) : 0;
+                if (OnFile && write_block(Index, Entries, OnFile)) {
+                    return true;
+                }
+                for (size_t i = OnFile; i < Count; ++i)
+                {
+                    if (write_at(Index + int64_t(i), Entries[i])) {
+                        return true;
+                    }
+                }
                 return false;
             }
 
@@ -149,54 +262,134 @@ namespace mz {
 
             bool insert(row_type const& Row) noexcept
             {
-                if (Row.Index != NumIndexes)
+                std::lock_guard Lock{ AppendLock };
+                size_t Next = NumIndexes.load(std::memory_order_relaxed);
+
+                if (Row.Index != Next)
                 {
                     mz::ErrLog << std::format("insert_entry(...) Index mismatch.  {}\n", mz::db::db_time::now().string());
                     Row.Index = -3;
                     return true;
                 }
 
+                if (!Landing.empty())
+                {
+                    mz::ErrLog << std::format("insert_entry(...) {} async inserts in flight.  {}\n", Landing.size(), mz::db::db_time::now().string());
+                    Row.Index = -3;
+                    return true;
+                }
+
                 if (!good())
                 {
                     mz::ErrLog << std::format("insert_entry(...) not good.  {}\n", mz::db::db_time::now().string());
-                    Errors.IO = 1;
+                    Errors.raise([](auto& E) { E.IO = 1; });
                     Row.Index = -2;
                     return true;
                 }
 
-                if (NumIndexes >= MaxIndexes)
+                if (Next >= MaxIndexes)
                 {
                     mz::ErrLog << std::format("insert_entry(...) Index overflow.  {}\n", mz::db::db_time::now().string());
-                    Errors.IndexOverflow = 1;
+                    Errors.raise([](auto& E) { E.IndexOverflow = 1; });
                     Row.Index = -3;
                     return true;
                 }
 
+                if (FlushRows <= 1 || SyncMode == db_sync_mode::always)
+                {
+                    if (write_block(Next, &Row.Entry, 1))
+                    {
+                        mz::ErrLog << std::format("insert_entry(...) write error.  {}\n", mz::db::db_time::now().string());
+                        Row.Index = -5;
+                        return true;
+                    }
+                    if (SyncMode != db_sync_mode::none && datasync())
+                    {
+                        mz::ErrLog << std::format("insert_entry(...) sync error.  {}\n", mz::db::db_time::now().string());
+                        Row.Index = -6;
+                        return true;
+                    }
+                    Flushed.store(Next + 1, std::memory_order_release);
+                }
+                else
+                {
+                    if (Pending.empty()) {
+                        PendingSince = std::chrono::steady_clock::now();
+                    }
+                    Pending.push_back(Row.Entry);
+                }
 
+                Row.Index = static_cast<int64_t>(Next);
+                NumIndexes.store(Next + 1, std::memory_order_release);
 
-                if (File.bseek_end(0))
+                if (!Pending.empty() && (Pending.size() >= FlushRows || flush_due()) && flush_pending())
                 {
-                    mz::ErrLog << std::format("insert_entry(...) seekp_end error.  {}\n", mz::db::db_time::now().string());
-                    Errors.seekp = 1;
-                    Row.Index = -4;
+                    mz::ErrLog << std::format("insert_entry(...) flush error, {} rows kept pending.  {}\n", Pending.size(), mz::db::db_time::now().string());
+                }
+                return false;
+            }
+
+            // appends Count rows at Index == count() with one write, after the pending inserts.
+            // synced unless the sync mode is none. a failed write is cut off the file again,
+            // count() stays as it was.
+            bool insert_range(int64_t Index, T const* Entries, size_t Count) noexcept
+            {
+                if (!Count) {
+                    return false;
+                }
+                std::lock_guard Lock{ AppendLock };
+                size_t Next = NumIndexes.load(std::memory_order_relaxed);
+
+                if (Index != int64_t(Next) || !Landing.empty())
+                {
+                    mz::ErrLog << std::format("insert_range({},{}) Index mismatch.  {}\n", Index, Count, mz::db::db_time::now().string());
                     return true;
                 }
 
-                if (File.write(Row.Entry))
+                if (!good())
                 {
-                    mz::ErrLog << std::format("insert_entry(...) seekp_end error.  {}\n", mz::db::db_time::now().string());
-                    Errors.write = 1;
-                    Row.Index = -5;
+                    mz::ErrLog << std::format("insert_range({},{}) not good.  {}\n", Index, Count, mz::db::db_time::now().string());
+                    Errors.raise([](auto& E) { E.IO = 1; });
+                    return true;
+                }
+
+                if (Count > MaxIndexes - Next)
+                {
+                    mz::ErrLog << std::format("insert_range({},{}) Index overflow.  {}\n", Index, Count, mz::db::db_time::now().string());
+                    return true;
+                }
+
+                if (flush_pending()) {
+                    return true;
+                }
+                if (write_block(int64_t(Next), Entries, Count) || (SyncMode != db_sync_mode::none && datasync()))
+                {
+                    mz::ErrLog << std::format("insert_range({},{}) write error.  {}\n", Index, Count, mz::db::db_time::now().string());
+                    Direct.resize(int64_t(row_offset(Next)));
                     return true;
                 }
-                Row.Index = static_cast<int64_t>(NumIndexes++);
+                Flushed.store(Next + Count, std::memory_order_release);
+                NumIndexes.store(Next + Count, std::memory_order_release);
                 return false;
             }
 
 
             int64_t pop() noexcept
             {
-                if (NumIndexes > 0) {
+                std::lock_guard Lock{ AppendLock };
+                if (NumIndexes > 0 && Landing.empty()) {
+                    if (!Pending.empty()) {
+                        Pending.pop_back();
+                    }
+                    else {
+                        // cut the row off the file, otherwise it is live again after open()
+                        if (Direct.resize(int64_t(row_offset(NumIndexes - 1))))
+                        {
+                            mz::ErrLog << std::format("pop() Direct.resize({}) fail", NumIndexes - 1);
+                            Errors.raise([](auto& E) { E.write = 1; });
+                        }
+                        Flushed.store(NumIndexes - 1, std::memory_order_release);
+                    }
                     return int64_t(--NumIndexes);
                 }
                 else {
@@ -206,8 +399,230 @@ namespace mz {
 
 
 
+
+            // inserts are collected in memory and written as one block once Rows are pending,
+            // when the oldest pending row is older than Delay (checked by insert and poll) or
+            // on flush(). Rows <= 1 writes every insert directly, which is the default.
+            void buffer_inserts(size_t Rows, mz::db::db_duration Delay, mz::db::db_sync_mode Mode) noexcept
+            {
+                std::lock_guard Lock{ AppendLock };
+                flush_pending();
+                FlushRows = Rows;
+                FlushDelay = Delay;
+                SyncMode = Mode;
+                Pending.reserve(Rows);
+            }
+
+            // writes pending inserts, returns true on failure and keeps them pending.
+            bool flush() noexcept
+            {
+                std::lock_guard Lock{ AppendLock };
+                return flush_pending();
+            }
+
+            // flushes pending inserts whose Delay expired, meant to be called periodically.
+            bool poll() noexcept
+            {
+                std::lock_guard Lock{ AppendLock };
+                if (!Pending.empty() && flush_due()) {
+                    return flush_pending();
+                }
+                return false;
+            }
+
+            // flushes pending inserts and syncs the file regardless of the sync mode.
+            bool sync() noexcept
+            {
+                std::lock_guard Lock{ AppendLock };
+                return flush_pending() || datasync();
+            }
+
+
+
+            // row the next async_insert gets, count() while no async insert is in flight
+            int64_t next_index() const noexcept
+            {
+                std::lock_guard Lock{ AppendLock };
+                return count() + int64_t(Landing.size());
+            }
+
+
+            // asynchronous select, select_range, update and insert through Ring: Done(Row, Failed),
+            // or Done(Failed) for a range, runs from Ring.wait() or Ring.poll() once the I/O
+            // completed. Row and Entries must stay alive and untouched until then. rows still
+            // pending in memory complete without I/O. the synchronous functions keep their
+            // positional reads and writes, they are safe to call from any thread while a ring
+            // belongs to one.
+            void async_select(db_io_ring& Ring, row_type& Row, auto&& Done)
+            {
+                auto Fail = [&Row, Done](int64_t) mutable
+                    {
+                        Row.Index = -112;
+                        Done(Row, true);
+                    };
+                if (!good(Row.Index))
+                {
+                    db_events::post(db_event::storage_async_select_fail, Source, Row.Index);
+                    Ring.post(std::move(Fail));
+                    return;
+                }
+                if (size_t(Row.Index) >= Flushed.load(std::memory_order_acquire) && access_pending(Row.Index, [&](T& P) { Row.Entry = P; }))
+                {
+                    Ring.post([&Row, Done](int64_t) mutable { Done(Row, false); });
+                    return;
+                }
+                Ring.read(Direct, &Row.Entry, RecordSize, int64_t(row_offset(Row.Index)), [this, &Row, Done, Fail](int64_t Res) mutable
+                    {
+                        if (Res < 0)
+                        {
+                            mz::ErrLog << std::format("async_select({}) read fail {}", Row.Index, Res);
+                            Errors.raise([](auto& E) { E.read = 1; });
+                            Fail(Res);
+                            return;
+                        }
+                        IoStats.read(RecordSize);
+                        Done(Row, false);
+                    });
+            }
+
+            void async_select_range(db_io_ring& Ring, int64_t Index, T* Entries, size_t Count, auto&& Done)
+            {
+                if (!Count) {
+                    Ring.post([Done](int64_t) mutable { Done(false); });
+                    return;
+                }
+                if (Index < 0 || !good(size_t(Index) + Count - 1))
+                {
+                    mz::ErrLog << std::format("async_select_range({},{}) fail", Index, Count);
+                    Ring.post([Done](int64_t) mutable { Done(true); });
+                    return;
+                }
+
+                size_t First = Flushed.load(std::memory_order_acquire);
+                size_t OnFile = size_t(Index) < First ? std::min(Count, First - size_t(Index)) : 0;
+                for (size_t i = OnFile; i < Count; ++i)
+                {
+                    if (read_at(Index + int64_t(i), Entries[i])) {
+                        Ring.post([Done](int64_t) mutable { Done(true); });
+                        return;
+                    }
+                }
+                if (!OnFile) {
+                    Ring.post([Done](int64_t) mutable { Done(false); });
+                    return;
+                }
+                Ring.read(Direct, Entries, RecordSize * OnFile, int64_t(row_offset(Index)), [this, Index, OnFile, Done](int64_t Res) mutable
+                    {
+                        if (Res < 0)
+                        {
+                            mz::ErrLog << std::format("async_select_range({},{}) read fail {}", Index, OnFile, Res);
+                            Errors.raise([](auto& E) { E.read = 1; });
+                        }
+                        else {
+                            IoStats.read(RecordSize * OnFile);
+                        }
+                        Done(Res < 0);
+                    });
+            }
+
+            void async_update(db_io_ring& Ring, row_type const& Row, auto&& Done)
+            {
+                if (!good(Row.Index))
+                {
+                    db_events::post(db_event::storage_async_update_fail, Source, Row.Index);
+                    Row.Index = -113;
+                    Ring.post([&Row, Done](int64_t) mutable { Done(Row, true); });
+                    return;
+                }
+                if (size_t(Row.Index) >= Flushed.load(std::memory_order_acquire) && access_pending(Row.Index, [&](T& P) { P = Row.Entry; }))
+                {
+                    Ring.post([&Row, Done](int64_t) mutable { Done(Row, false); });
+                    return;
+                }
+                Ring.write(Direct, &Row.Entry, RecordSize, int64_t(row_offset(Row.Index)), [this, &Row, Done](int64_t Res) mutable
+                    {
+                        if (Res < 0)
+                        {
+                            mz::ErrLog << std::format("async_update({}) write fail {}", Row.Index, Res);
+                            Errors.raise([](auto& E) { E.write = 1; });
+                            Row.Index = -113;
+                        }
+                        else {
+                            IoStats.wrote(RecordSize);
+                        }
+                        Done(Row, Res < 0);
+                    });
+            }
+
+            // appends Row.Entry and sets Row.Index to its row. with buffered inserts the row goes
+            // to Pending as insert() does. otherwise the write is queued and the row is counted
+            // once it and every row before it landed, synced first unless the sync mode is none.
+            // a failed write marks the storage bad and fails the rows queued behind it, see
+            // abandon().
+            void async_insert(db_io_ring& Ring, row_type& Row, auto&& Done)
+            {
+                std::unique_lock Lock{ AppendLock };
+                if (FlushRows > 1 && SyncMode != db_sync_mode::always && Landing.empty())
+                {
+                    Row.Index = count();
+                    Lock.unlock();
+                    bool Failed = insert(Row);
+                    Ring.post([&Row, Done, Failed](int64_t) mutable { Done(Row, Failed); });
+                    return;
+                }
+
+                size_t Next = NumIndexes.load(std::memory_order_relaxed) + Landing.size();
+                if (!good() || !Pending.empty() || Next >= MaxIndexes)
+                {
+                    mz::ErrLog << std::format("async_insert(...) fail at {}.  {}\n", Next, mz::db::db_time::now().string());
+                    if (Next >= MaxIndexes) {
+                        Errors.raise([](auto& E) { E.IndexOverflow = 1; });
+                    }
+                    Row.Index = -3;
+                    Ring.post([&Row, Done](int64_t) mutable { Done(Row, true); });
+                    return;
+                }
+                Row.Index = int64_t(Next);
+                Landing.push_back(false);
+                Lock.unlock();
+
+                auto Land = [this, &Row, Done](int64_t Res) mutable
+                    {
+                        if (Res < 0)
+                        {
+                            mz::ErrLog << std::format("async_insert({}) write error {}.  {}\n", Row.Index, Res, mz::db::db_time::now().string());
+                            abandon(size_t(Row.Index));
+                            Row.Index = -5;
+                            Done(Row, true);
+                            return;
+                        }
+                        IoStats.wrote(RecordSize);
+                        if (land(size_t(Row.Index)))
+                        {
+                            mz::ErrLog << std::format("async_insert({}) dropped after an earlier write error.  {}\n", Row.Index, mz::db::db_time::now().string());
+                            Row.Index = -5;
+                            Done(Row, true);
+                            return;
+                        }
+                        Done(Row, false);
+                    };
+                Ring.write(Direct, &Row.Entry, RecordSize, int64_t(row_offset(Next)), [this, &Ring, Land](int64_t Res) mutable
+                    {
+                        if (Res < 0 || SyncMode == db_sync_mode::none) {
+                            Land(Res);
+                        }
+                        else {
+                            Ring.datasync(Direct, std::move(Land));
+                        }
+                    });
+            }
+
+
+
             db_table_file() noexcept = default;
 
+            ~db_table_file() { flush(); }
+
             bool create(std::wstring const& Path, size_t max_size) noexcept
             {
                 //fmt::print("creating table_file\n");
@@ -225,6 +640,7 @@ namespace mz {
                 NumIndexes = 0;
                 MaxIndexes = 0;
                 Errors.value = 0;
+                Source = Name.filename().string();
                 std::string ErrMsg2 { std::format("storage[{}]::open: ", Name.string()) };
                 if (Name.empty()) {
                     Errors.open = 1;
@@ -250,9 +666,10 @@ namespace mz {
                     return -4;
                 }
 
-                if (!File.create(Name, O_BINARY))
+                if (!File.create(Name, O_BINARY) || !Direct.create(Name))
                 {
                     File.close();
+                    Direct.close();
                     Errors.open = 1;
                     ErrMsg2 += std::format("failed to create/open file:\n{}", report_errors());
                     mz::ErrLog << ErrMsg2;
@@ -262,6 +679,7 @@ namespace mz {
                 auto L = File.size();
                 if (File.fail() || L < 0) {
                     File.close();
+                    Direct.close();
                     Errors.IO = 1;
                     Errors.open = 1;
                     ErrMsg2 += std::format("File.fail() || L(={}) < 0:\n{}", L, report_errors());
@@ -272,6 +690,7 @@ namespace mz {
                 if (L % RecordSize)
                 {
                     File.close();
+                    Direct.close();
                     Errors.open = 1;
                     Errors.Corrupted = 1;
                     ErrMsg2 += std::format("File.size(={}) % RecordSize(={}) = {} != 0\n", L, RecordSize, L % RecordSize);
@@ -281,44 +700,59 @@ namespace mz {
 
                 MaxIndexes = max_indexes;
                 NumIndexes = L / RecordSize;
+                Flushed = L / RecordSize;
+                Pending.clear();
+                Landing.clear();
                 if (NumIndexes >= MaxIndexes)
                 {
                     File.close();
+                    Direct.close();
                     Errors.open = 1;
                     Errors.IndexOverflow = 1;
-                    ErrMsg2 += std::format("NumIndex(={}) >= MaxIndexes(={})\n", NumIndexes, MaxIndexes);
+                    ErrMsg2 += std::format("NumIndex(={}) >= MaxIndexes(={})\n", count(), MaxIndexes);
                     mz::ErrLog << ErrMsg2;
                     return -8;
                 }
 
-                if (seekg_index(0))
+                if (count() && seekg_index(0))
                 {
                     File.close();
+                    Direct.close();
                     Errors.open = 1;
                     ErrMsg2 += std::format("seekg_set\n{}", report_errors());
                     mz::ErrLog << ErrMsg2;
                     return -9;
                 }
 
-                if (seekp_index(count()))
-                {
-                    File.close();
-                    Errors.open = 1;
-                    ErrMsg2 += std::format("seekp_end\n{}", report_errors());
-                    mz::ErrLog << ErrMsg2;
-                    return -10;
-                }
-
                 ErrMsg2.clear();
                 return 0;
             }
 
 
 
+            void close() noexcept
+            {
+                flush();
+                std::lock_guard Lock{ AppendLock };
+                File.close();
+                Direct.close();
+                NumIndexes = 0;
+                Flushed = 0;
+                MaxIndexes = 0;
+                Landing.clear();
+            }
+
+
+
             bool generate_report(std::string& Report, auto&& Func) {
                 Report += std::format("Number of Record : {}\n"
                     "------------------------------\n", count());
 
+                if (flush()) {
+                    Report += "Error Writing File.\n";
+                    return true;
+                }
+
                 if (!count()) {
                     Report += "No Records Exists.\n";
                     return false;
@@ -360,6 +794,7 @@ namespace mz {
                     Errors.read = 1;
                     return true;
                 }
+                IoStats.read(RecordSize);
 
                 return false;
             }
@@ -372,6 +807,7 @@ namespace mz {
                     Errors.write = 1;
                     return true;
                 }
+                IoStats.wrote(RecordSize);
 
                 return false;
             }
@@ -384,21 +820,59 @@ namespace mz {
             }
 
 
+            bool read_at(int64_t Index, T& Entry) const noexcept
+            {
+                if (size_t(Index) >= Flushed.load(std::memory_order_acquire) && const_cast<db_table_file*>(this)->access_pending(Index, [&](T& P) { Entry = P; }))
+                {
+                    return false;
+                }
+                if (Direct.read_at(&Entry, RecordSize, int64_t(row_offset(Index))))
+                {
+                    mz::ErrLog << std::format("storage[{}]::read_at({}) Direct.read_at fail.  {}\n", Source, Index, mz::db::db_time::now().string());
+                    Errors.raise([](auto& E) { E.read = 1; });
+                    return true;
+                }
+                IoStats.read(RecordSize);
+                return false;
+            }
+
+            bool write_at(int64_t Index, T const& Entry) noexcept
+            {
+                if (size_t(Index) >= Flushed.load(std::memory_order_acquire) && access_pending(Index, [&](T& P) { P = Entry; }))
+                {
+                    return false;
+                }
+                return write_block(Index, &Entry, 1);
+            }
+
+            bool write_block(int64_t Index, T const* Entries, size_t Count) noexcept
+            {
+                if (Direct.write_at(Entries, RecordSize * Count, int64_t(row_offset(Index))))
+                {
+                    mz::ErrLog << std::format("storage[{}]::write_block({}, {}) Direct.write_at fail.  {}\n", Source, Index, Count, mz::db::db_time::now().string());
+                    Errors.raise([](auto& E) { E.write = 1; });
+                    return true;
+                }
+                IoStats.wrote(RecordSize * Count);
+                return false;
+            }
+
+
             bool good(size_t Index) const noexcept
             {
-                if (Index < NumIndexes)
+                if (Index < size_t(count()))
                 {
-                    if (!Errors.value) {
+                    if (uint32_t Bits = Errors.bits(); !Bits) {
                         return true;
                     }
                     else {
-                        Errors.IO = 1;
-                        mz::ErrLog << std::format("Pre-Existing Errors:{} while requesting good({})", Errors.value, Index);
+                        Errors.raise([](auto& E) { E.IO = 1; });
+                        mz::ErrLog << std::format("storage[{}]::good({}) Pre-Existing Errors:{}.  {}\n", Source, Index, Bits, mz::db::db_time::now().string());
                         return false;
                     }
                 }
                 else {
-                    mz::ErrLog << std::format("good({}) index out bounds for NumIndexes = {}", Index, NumIndexes);
+                    db_events::post(db_event::storage_out_of_bounds, Source, int64_t(Index), count());
                     return false;
                 }
             }
@@ -445,6 +919,94 @@ namespace mz {
 
 
 
+        protected:
+
+
+            // runs Func on the pending copy of row Index, false if it was flushed meanwhile.
+            bool access_pending(int64_t Index, auto&& Func) noexcept
+            {
+                std::lock_guard Lock{ AppendLock };
+                size_t First = Flushed.load(std::memory_order_relaxed);
+                if (size_t(Index) < First || size_t(Index) - First >= Pending.size()) {
+                    return false;
+                }
+                Func(Pending[size_t(Index) - First]);
+                return true;
+            }
+
+            // marks the async insert of row Index written and counts the rows written in order
+            // returns true when the row was given up by abandon() while its write was in flight,
+            // the file is cut again in case the write extended it
+            bool land(size_t Index) noexcept
+            {
+                std::lock_guard Lock{ AppendLock };
+                size_t First = NumIndexes.load(std::memory_order_relaxed);
+                if (Index < First || Index - First >= Landing.size())
+                {
+                    Direct.resize(int64_t(row_offset(First + Landing.size())));
+                    return true;
+                }
+                Landing[Index - First] = true;
+                while (!Landing.empty() && Landing.front())
+                {
+                    Landing.pop_front();
+                    Flushed.store(First + 1, std::memory_order_release);
+                    NumIndexes.store(++First, std::memory_order_release);
+                }
+                return false;
+            }
+
+            // a failed async write at Index gives up on it and on every row handed out behind
+            // it, so Landing has no hole that would hold back the rows after it forever. the
+            // file is cut back to the rows before Index and the storage is bad from then on,
+            // the writes still in flight for the rows behind fail in land().
+            void abandon(size_t Index) noexcept
+            {
+                std::lock_guard Lock{ AppendLock };
+                Errors.raise([](auto& E) { E.write = 1; });
+                size_t First = NumIndexes.load(std::memory_order_relaxed);
+                if (Index >= First && Index - First < Landing.size()) {
+                    Landing.resize(Index - First);
+                }
+                Direct.resize(int64_t(row_offset(First + Landing.size())));
+            }
+
+            bool flush_due() const noexcept
+            {
+                return std::chrono::steady_clock::now() - PendingSince >= FlushDelay;
+            }
+
+            bool datasync() noexcept
+            {
+                if (Direct.datasync())
+                {
+                    mz::ErrLog << std::format("datasync() Direct.datasync fail");
+                    Errors.raise([](auto& E) { E.write = 1; });
+                    return true;
+                }
+                return false;
+            }
+
+            // AppendLock held
+            bool flush_pending() noexcept
+            {
+                if (Pending.empty()) {
+                    return false;
+                }
+                size_t First = Flushed.load(std::memory_order_relaxed);
+                if (write_block(First, Pending.data(), Pending.size())) {
+                    return true;
+                }
+                if (SyncMode == db_sync_mode::batch && datasync()) {
+                    return true;
+                }
+                Flushed.store(First + Pending.size(), std::memory_order_release);
+                Pending.clear();
+                return false;
+            }
+
+
+
 
         };
 
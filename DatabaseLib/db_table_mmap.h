@@ -0,0 +1,539 @@
+#ifndef DB_TABLE_MMAP_TEMPLATE_HEADER_FILE
+#define DB_TABLE_MMAP_TEMPLATE_HEADER_FILE
+#pragma once
+
+#include <new>
+#include <span>
+#include <string>
+#include <format>
+#include <cstring>
+#include <algorithm>
+#include <filesystem>
+
+#include "logger.h"
+#include "time_conversions.h"
+#include "db_concepts.h"
+#include "db_file_io.h"
+#include "db_table_file.h"
+#include "db_stats.h"
+#include "db_events.h"
+
+
+namespace mz {
+    namespace db {
+
+
+        // memory mapped alternative to db_table_file with the same file layout,
+        // a table file can be opened with either of them.
+        // rows are read and written in place, the file grows in chunks of GrowRows
+        // records and the unused tail is cut back on close().
+        // records past the last row are all zero bytes, which is never a valid entry,
+        // so a tail left behind by a crash is dropped on the next open().
+        template <mz::db::EntryType T>
+        class db_table_mmap
+        {
+
+        public:
+
+            static constexpr size_t RecordSize{ sizeof(T) };
+            static constexpr size_t DefaultGrowBytes{ size_t(1) << 24 };
+
+            using entry_type = T;
+            using row_type = indexed_record<entry_type>;
+
+            mz::db::db_native_file File;
+            mz::db::db_file_view View;
+            size_t MaxIndexes{ 0 };
+            size_t NumIndexes{ 0 };
+            size_t MappedIndexes{ 0 };
+            size_t GrowRows{ std::max<size_t>(DefaultGrowBytes / RecordSize, 1) };
+            mutable int64_t Cursor{ 0 };
+
+            mutable mz::db::db_table_errors Errors;
+            mutable std::string ErrMsg{};
+            std::string Source{};   // file name, names the storage in its events and messages
+
+            // bytes copied from and to the mapping, counted only when DB_TABLE_STATS is on
+            [[no_unique_address]] mz::db::db_io_counters IoStats{};
+
+            std::string report_errors() const noexcept {
+                return std::format("{}", Errors.value);
+            }
+
+
+            constexpr size_t row_offset(size_t Index) const noexcept { return RecordSize * Index; }
+            constexpr int64_t count() const noexcept { return (int64_t)NumIndexes; }
+            constexpr int64_t last_index() const noexcept { return int64_t(NumIndexes) - 1; }
+            constexpr uint32_t nextIndex() const noexcept { return uint32_t(NumIndexes); }
+            bool bad() const noexcept { return Errors.value || !File.is_open(); }
+            bool fail() const noexcept { return Errors.value || !File.is_open(); }
+            bool good() const noexcept { return !Errors.value && File.is_open(); }
+
+
+
+            // direct reference into the mapping, nullptr when Index is out of bounds.
+            // the pointer is invalidated by the next insert() that grows the file.
+            entry_type const* entry_at(int64_t Index) const noexcept
+            {
+                return good(Index) ? slot(Index) : nullptr;
+            }
+
+            entry_type* entry_at(int64_t Index) noexcept
+            {
+                return good(Index) ? slot(Index) : nullptr;
+            }
+
+
+            bool select(row_type& Row) const noexcept
+            {
+                if (!good(Row.Index))
+                {
+                    db_events::post(db_event::storage_select_fail, Source, Row.Index);
+                    Row.Index = -112;
+                    return true;
+                }
+                std::memcpy(&Row.Entry, slot(Row.Index), RecordSize);
+                IoStats.read(RecordSize);
+                return false;
+            }
+
+            // rows [Index, Index + Count) in place, empty when out of bounds.
+            // like entry_at, the view is invalidated by the next insert() that grows the file.
+            std::span<T const> view_range(int64_t Index, size_t Count) const noexcept
+            {
+                if (!Count || Index < 0 || !good(size_t(Index) + Count - 1)) {
+                    return {};
+                }
+                return std::span<T const>{ slot(Index), Count };
+            }
+
+            // copies rows [Index, Index + Count) into Entries
+            bool select_range(int64_t Index, T* Entries, size_t Count) const noexcept
+            {
+                if (!Count) {
+                    return false;
+                }
+                if (Index < 0 || !good(size_t(Index) + Count - 1))
+                {
+                    db_events::post(db_event::storage_select_range_fail, Source, Index, int64_t(Count));
+                    return true;
+                }
+                std::memcpy(static_cast<void*>(Entries), slot(Index), RecordSize * Count);
+                IoStats.read(RecordSize * Count);
+                return false;
+            }
+
+            bool update(row_type const& Row) noexcept
+            {
+                if (!good(Row.Index))
+                {
+                    Row.Index = -113;
+                    db_events::post(db_event::storage_update_fail, Source, Row.Index);
+                    return true;
+                }
+                std::memcpy(slot(Row.Index), &Row.Entry, RecordSize);
+                IoStats.wrote(RecordSize);
+                return false;
+            }
+
+            bool update_range(int64_t Index, T const* Entries, size_t Count) noexcept
+            {
+                if (!Count) {
+                    return false;
+                }
+                if (Index < 0 || !good(size_t(Index) + Count - 1))
+                {
+                    db_events::post(db_event::storage_update_range_fail, Source, Index, int64_t(Count));
+                    return true;
+                }
+                std::memcpy(static_cast<void*>(slot(Index)), Entries, RecordSize * Count);
+                IoStats.wrote(RecordSize * Count);
+                return false;
+            }
+
+            bool filter(row_type& Row, auto&& Func) noexcept
+            {
+                if (select(Row))
+                {
+                    mz::ErrLog << std::format("filter({}) select fail", Row.Index);
+                    Row.Index = -123;
+                    return true;
+                }
+                if (Func(Row)) {
+                    return true;
+                }
+
+                if (update(Row)) {
+                    mz::ErrLog << std::format("filter({}) update fail", Row.Index);
+                    Row.Index = -125;
+                    return true;
+                }
+                return false;
+            }
+
+
+
+
+            bool insert(row_type const& Row) noexcept
+            {
+                if (Row.Index != count())
+                {
+                    mz::ErrLog << std::format("insert_entry(...) Index mismatch.  {}\n", mz::db::db_time::now().string());
+                    Row.Index = -3;
+                    return true;
+                }
+
+                if (!good())
+                {
+                    mz::ErrLog << std::format("insert_entry(...) not good.  {}\n", mz::db::db_time::now().string());
+                    Errors.IO = 1;
+                    Row.Index = -2;
+                    return true;
+                }
+
+                if (NumIndexes >= MaxIndexes)
+                {
+                    mz::ErrLog << std::format("insert_entry(...) Index overflow.  {}\n", mz::db::db_time::now().string());
+                    Errors.IndexOverflow = 1;
+                    Row.Index = -3;
+                    return true;
+                }
+
+                if (NumIndexes >= MappedIndexes && grow(NumIndexes + 1))
+                {
+                    mz::ErrLog << std::format("insert_entry(...) grow error.  {}\n", mz::db::db_time::now().string());
+                    Row.Index = -5;
+                    return true;
+                }
+
+                std::memcpy(slot(NumIndexes), &Row.Entry, RecordSize);
+                IoStats.wrote(RecordSize);
+                Row.Index = static_cast<int64_t>(NumIndexes++);
+                return false;
+            }
+
+            // appends Count rows at Index == count() with one copy into the mapping
+            bool insert_range(int64_t Index, T const* Entries, size_t Count) noexcept
+            {
+                if (!Count) {
+                    return false;
+                }
+                if (Index != count() || !good() || Count > MaxIndexes - NumIndexes)
+                {
+                    mz::ErrLog << std::format("insert_range({},{}) fail.  {}\n", Index, Count, mz::db::db_time::now().string());
+                    return true;
+                }
+
+                if (NumIndexes + Count > MappedIndexes && grow(NumIndexes + Count))
+                {
+                    mz::ErrLog << std::format("insert_range({},{}) grow error.  {}\n", Index, Count, mz::db::db_time::now().string());
+                    return true;
+                }
+
+                std::memcpy(static_cast<void*>(slot(NumIndexes)), Entries, RecordSize * Count);
+                IoStats.wrote(RecordSize * Count);
+                NumIndexes += Count;
+                return false;
+            }
+
+
+            int64_t pop() noexcept
+            {
+                if (NumIndexes > 0) {
+                    --NumIndexes;
+                    std::memset(static_cast<void*>(slot(NumIndexes)), 0, RecordSize);
+                    return int64_t(NumIndexes);
+                }
+                else {
+                    return -1;
+                }
+            }
+
+
+
+            db_table_mmap() noexcept = default;
+            db_table_mmap(db_table_mmap const&) = delete;
+            db_table_mmap& operator = (db_table_mmap const&) = delete;
+
+            ~db_table_mmap() { close(); }
+
+
+            int open(std::filesystem::path const& Name, size_t max_indexes) noexcept
+            {
+                Source = Name.filename().string();
+                if (File.is_open()) {
+                    close();
+                    Errors.open = 1;
+                    mz::ErrLog << std::format("storage[{}]::open: trying to reopen and open file\n", Name.string());
+                    return -3;
+                }
+
+                NumIndexes = 0;
+                MaxIndexes = 0;
+                MappedIndexes = 0;
+                Cursor = 0;
+                Errors.value = 0;
+                std::string ErrMsg2{ std::format("storage[{}]::open: ", Name.string()) };
+                if (Name.empty()) {
+                    Errors.open = 1;
+                    ErrMsg2 += "Name Empty\n";
+                    mz::ErrLog << ErrMsg2;
+                    return -1;
+                }
+
+                if (!max_indexes)
+                {
+                    Errors.open = 1;
+                    ErrMsg2 += "invalid maximum row numbers == 0\n";
+                    mz::ErrLog << ErrMsg2;
+                    return -4;
+                }
+
+                if (!File.create(Name))
+                {
+                    Errors.open = 1;
+                    ErrMsg2 += "failed to create/open file\n";
+                    mz::ErrLog << ErrMsg2;
+                    return -5;
+                }
+
+                auto L = File.size();
+                if (L < 0) {
+                    File.close();
+                    Errors.IO = 1;
+                    Errors.open = 1;
+                    ErrMsg2 += std::format("File.size(={}) < 0\n", L);
+                    mz::ErrLog << ErrMsg2;
+                    return -6;
+                }
+
+                if (L % RecordSize)
+                {
+                    File.close();
+                    Errors.open = 1;
+                    Errors.Corrupted = 1;
+                    ErrMsg2 += std::format("File.size(={}) % RecordSize(={}) = {} != 0\n", L, RecordSize, L % RecordSize);
+                    mz::ErrLog << ErrMsg2;
+                    return -7;
+                }
+
+                MaxIndexes = max_indexes;
+                MappedIndexes = size_t(L) / RecordSize;
+                if (MappedIndexes && !View.map(File, row_offset(MappedIndexes)))
+                {
+                    File.close();
+                    MappedIndexes = 0;
+                    Errors.open = 1;
+                    Errors.IO = 1;
+                    ErrMsg2 += std::format("failed to map {} bytes\n", L);
+                    mz::ErrLog << ErrMsg2;
+                    return -11;
+                }
+
+                NumIndexes = MappedIndexes;
+                while (NumIndexes && is_zero(slot(NumIndexes - 1))) {
+                    --NumIndexes;
+                }
+
+                if (NumIndexes >= MaxIndexes)
+                {
+                    close();
+                    Errors.open = 1;
+                    Errors.IndexOverflow = 1;
+                    ErrMsg2 += std::format("NumIndex(={}) >= MaxIndexes(={})\n", NumIndexes, MaxIndexes);
+                    mz::ErrLog << ErrMsg2;
+                    return -8;
+                }
+
+                ErrMsg2.clear();
+                return 0;
+            }
+
+
+            // unmaps the file and cuts the preallocated tail back to count() records.
+            void close() noexcept
+            {
+                if (!File.is_open()) {
+                    return;
+                }
+                View.unmap();
+                if (MappedIndexes != NumIndexes && File.resize(int64_t(row_offset(NumIndexes))))
+                {
+                    mz::ErrLog << std::format("db_table_mmap::close() resize({}) fail\n", NumIndexes);
+                    Errors.IO = 1;
+                }
+                MappedIndexes = 0;
+                File.close();
+            }
+
+
+            // writes the dirty pages of the mapping back to disk.
+            bool sync() noexcept
+            {
+                if (View.flush())
+                {
+                    mz::ErrLog << std::format("db_table_mmap::sync() fail\n");
+                    Errors.write = 1;
+                    return true;
+                }
+                return false;
+            }
+
+
+
+            bool generate_report(std::string& Report, auto&& Func) {
+                Report += std::format("Number of Record : {}\n"
+                    "------------------------------\n", count());
+
+                if (!count()) {
+                    Report += "No Records Exists.\n";
+                    return false;
+                }
+
+                for (int64_t i = 0; i < count(); i++) {
+                    Report += Func(*slot(i));
+                }
+                return false;
+            }
+
+
+
+
+            // sequential access through a cursor, kept for compatibility with db_table_file.
+
+            bool select_next(T& Entry) const noexcept
+            {
+                if (Cursor < 0 || Cursor >= count())
+                {
+                    mz::ErrLog << std::format("select_next() read past end");
+                    Errors.read = 1;
+                    return true;
+                }
+                std::memcpy(&Entry, slot(Cursor++), RecordSize);
+                IoStats.read(RecordSize);
+                return false;
+            }
+
+            bool update_next(T const& Entry) noexcept
+            {
+                if (Cursor < 0 || Cursor >= count())
+                {
+                    mz::ErrLog << std::format("update_next() write past end");
+                    Errors.write = 1;
+                    return true;
+                }
+                std::memcpy(slot(Cursor++), &Entry, RecordSize);
+                IoStats.wrote(RecordSize);
+                return false;
+            }
+
+            bool filter_next(T& Entry, auto&& filter) noexcept
+            {
+                if (select_next(Entry)) { return true; }
+                if (!filter(Entry)) { return false; }
+                --Cursor;
+                return update_next(Entry);
+            }
+
+
+            bool good(size_t Index) const noexcept
+            {
+                if (Index < NumIndexes)
+                {
+                    if (!Errors.value) {
+                        return true;
+                    }
+                    else {
+                        Errors.IO = 1;
+                        mz::ErrLog << std::format("storage[{}]::good({}) Pre-Existing Errors:{}.  {}\n", Source, Index, Errors.value, mz::db::db_time::now().string());
+                        return false;
+                    }
+                }
+                else {
+                    db_events::post(db_event::storage_out_of_bounds, Source, int64_t(Index), int64_t(NumIndexes));
+                    return false;
+                }
+            }
+
+
+            bool seekg_index(int64_t Index) const noexcept
+            {
+                if (!good(Index))
+                {
+                    mz::ErrLog << std::format("seekg_index({}) not good", Index);
+                    return true;
+                }
+                Cursor = Index;
+                return false;
+            }
+
+
+            bool seekp_index(int64_t Index) noexcept
+            {
+                if (!good(Index))
+                {
+                    mz::ErrLog << std::format("seekp_index({}) not good", Index);
+                    return true;
+                }
+                Cursor = Index;
+                return false;
+            }
+
+
+
+        protected:
+
+
+            entry_type* slot(size_t Index) const noexcept
+            {
+                return std::launder(reinterpret_cast<entry_type*>(View.data() + row_offset(Index)));
+            }
+
+            static bool is_zero(entry_type const* Entry) noexcept
+            {
+                auto Bytes = reinterpret_cast<unsigned char const*>(Entry);
+                return std::all_of(Bytes, Bytes + RecordSize, [](unsigned char B) { return B == 0; });
+            }
+
+
+            // grows the file and the mapping to hold at least Needed records.
+            bool grow(size_t Needed) noexcept
+            {
+                size_t Rows = std::min(MaxIndexes, std::max(Needed, MappedIndexes + GrowRows));
+                if (Rows < Needed) {
+                    Errors.IndexOverflow = 1;
+                    return true;
+                }
+
+                View.unmap();
+                if (File.resize(int64_t(row_offset(Rows))))
+                {
+                    mz::ErrLog << std::format("db_table_mmap::grow({}) resize fail\n", Rows);
+                    Errors.IO = 1;
+                    View.map(File, row_offset(MappedIndexes));
+                    return true;
+                }
+
+                if (!View.map(File, row_offset(Rows)))
+                {
+                    mz::ErrLog << std::format("db_table_mmap::grow({}) map fail\n", Rows);
+                    Errors.IO = 1;
+                    MappedIndexes = 0;
+                    return true;
+                }
+                MappedIndexes = Rows;
+                return false;
+            }
+
+        };
+
+
+
+    }
+};
+
+
+
+
+
+#endif
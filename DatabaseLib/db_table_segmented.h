@@ -0,0 +1,727 @@
+#ifndef DB_TABLE_SEGMENTED_TEMPLATE_HEADER_FILE
+#define DB_TABLE_SEGMENTED_TEMPLATE_HEADER_FILE
+#pragma once
+
+#include <span>
+#include <deque>
+#include <atomic>
+#include <string>
+#include <format>
+#include <future>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <cstring>
+#include <charconv>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+
+#include "logger.h"
+#include "time_conversions.h"
+#include "db_concepts.h"
+#include "db_file_io.h"
+#include "db_table_file.h"
+#include "db_stats.h"
+#include "db_events.h"
+
+
+namespace mz {
+    namespace db {
+
+
+        // storage engine keeping a table in segment files of SegmentRows records each,
+        // <Name>.000000, <Name>.000001, ... with the record layout of db_table_file.
+        // row Index is record Index % SegmentRows of segment Index / SegmentRows.
+        // a segment is created at its full size with its disk space reserved, and the one
+        // after the segment being appended to is created ahead on a thread of its own, so
+        // an insert never grows a file and costs the same however large the table is.
+        // records past the last row are all zero bytes, which is never a valid entry, as
+        // in db_table_mmap; open() finds the last row with a binary search over them.
+        // whole segments before the one holding the last row can be dropped or archived
+        // by drop_segment(), their rows fall below first_index() and are out of bounds.
+        template <mz::db::EntryType T>
+        class db_table_segmented
+        {
+
+        public:
+
+            static constexpr size_t RecordSize{ sizeof(T) };
+            static constexpr size_t DefaultSegmentBytes{ size_t(1) << 26 };
+            static constexpr size_t MaxRows{ size_t(1) << 36 };
+            static constexpr size_t ReadRows{ 4096 };   // rows select_next reads at once
+
+            using entry_type = T;
+            using row_type = indexed_record<entry_type>;
+
+            // rows per segment of a new table, an existing table keeps the size of its segments
+            size_t SegmentRows{ std::max<size_t>(DefaultSegmentBytes / RecordSize, 1) };
+            size_t MaxIndexes{ 0 };
+            std::atomic<size_t> NumIndexes{ 0 };
+            std::atomic<size_t> FirstSegment{ 0 };
+            size_t Segments{ 0 };      // segments [FirstSegment, Segments) are open
+            mutable int64_t Cursor{ 0 };
+
+            mutable mz::db::db_table_errors Errors;
+            mutable std::string ErrMsg{};
+            std::string Source{};   // file name, names the storage in its events and messages
+
+            // bytes read from and written to the segments, counted only when DB_TABLE_STATS is on
+            [[no_unique_address]] mz::db::db_io_counters IoStats{};
+
+            std::string report_errors() const noexcept {
+                return std::format("{}", Errors.value);
+            }
+
+
+            int64_t count() const noexcept { return int64_t(NumIndexes.load(std::memory_order_acquire)); }
+            int64_t last_index() const noexcept { return count() - 1; }
+            bool bad() const noexcept { return Errors.value || Files.empty(); }
+            bool fail() const noexcept { return Errors.value || Files.empty(); }
+            bool good() const noexcept { return !Errors.value && !Files.empty(); }
+
+            // rows [0, first_index()) were in dropped segments
+            int64_t first_index() const noexcept { return int64_t(FirstSegment.load(std::memory_order_acquire) * SegmentRows); }
+            size_t segment_rows() const noexcept { return SegmentRows; }
+
+            // bytes of the segment files on disk, -1 when one cannot be read. dropped segments
+            // count at their full size, the rows that were in them keep their numbers.
+            int64_t file_size() const noexcept
+            {
+                size_t First = FirstSegment.load(std::memory_order_acquire);
+                int64_t Bytes = int64_t(First) * segment_bytes();
+                for (size_t s = First; s < Segments; ++s)
+                {
+                    int64_t Size = Files[s].size();
+                    if (Size < 0) {
+                        return -1;
+                    }
+                    Bytes += Size;
+                }
+                return Bytes;
+            }
+
+            static std::filesystem::path segment_path(std::filesystem::path const& Name, size_t Segment)
+            {
+                auto Path = Name;
+                Path += std::format(".{:06}", Segment);
+                return Path;
+            }
+
+
+
+            bool select(row_type& Row) const noexcept
+            {
+                if (!good(Row.Index) || read_rows(Row.Index, &Row.Entry, 1))
+                {
+                    db_events::post(db_event::storage_select_fail, Source, Row.Index);
+                    Row.Index = -112;
+                    return true;
+                }
+                return false;
+            }
+
+            // copies rows [Index, Index + Count) into Entries, they may span segments
+            bool select_range(int64_t Index, T* Entries, size_t Count) const noexcept
+            {
+                if (!Count) {
+                    return false;
+                }
+                if (Index < 0 || !good(Index) || !good(size_t(Index) + Count - 1) || read_rows(Index, Entries, Count))
+                {
+                    db_events::post(db_event::storage_select_range_fail, Source, Index, int64_t(Count));
+                    return true;
+                }
+                return false;
+            }
+
+            bool update(row_type const& Row) noexcept
+            {
+                if (!good(Row.Index) || write_rows(Row.Index, &Row.Entry, 1))
+                {
+                    db_events::post(db_event::storage_update_fail, Source, Row.Index);
+                    Row.Index = -113;
+                    return true;
+                }
+                return false;
+            }
+
+            bool update_range(int64_t Index, T const* Entries, size_t Count) noexcept
+            {
+                if (!Count) {
+                    return false;
+                }
+                if (Index < 0 || !good(Index) || !good(size_t(Index) + Count - 1) || write_rows(Index, Entries, Count))
+                {
+                    db_events::post(db_event::storage_update_range_fail, Source, Index, int64_t(Count));
+                    return true;
+                }
+                return false;
+            }
+
+
+
+            bool insert(row_type const& Row) noexcept
+            {
+                size_t Next = NumIndexes.load(std::memory_order_relaxed);
+                if (Row.Index != int64_t(Next))
+                {
+                    mz::ErrLog << std::format("insert_entry(...) Index mismatch.  {}\n", mz::db::db_time::now().string());
+                    Row.Index = -3;
+                    return true;
+                }
+
+                if (!good())
+                {
+                    mz::ErrLog << std::format("insert_entry(...) not good.  {}\n", mz::db::db_time::now().string());
+                    Errors.IO = 1;
+                    Row.Index = -2;
+                    return true;
+                }
+
+                if (Next >= MaxIndexes)
+                {
+                    mz::ErrLog << std::format("insert_entry(...) Index overflow.  {}\n", mz::db::db_time::now().string());
+                    Errors.IndexOverflow = 1;
+                    Row.Index = -3;
+                    return true;
+                }
+
+                if (Next / SegmentRows >= Segments && next_segment())
+                {
+                    mz::ErrLog << std::format("insert_entry(...) segment {} create error.  {}\n", Segments, mz::db::db_time::now().string());
+                    Row.Index = -5;
+                    return true;
+                }
+
+                if (write_rows(int64_t(Next), &Row.Entry, 1))
+                {
+                    Row.Index = -4;
+                    return true;
+                }
+                NumIndexes.store(Next + 1, std::memory_order_release);
+                return false;
+            }
+
+            // appends Count rows at Index == count() with one write per segment they fall in.
+            // rows of a failed write are zeroed again so open() does not count them.
+            bool insert_range(int64_t Index, T const* Entries, size_t Count) noexcept
+            {
+                if (!Count) {
+                    return false;
+                }
+                size_t Next = NumIndexes.load(std::memory_order_relaxed);
+                if (Index != int64_t(Next) || !good() || Count > MaxIndexes - Next)
+                {
+                    mz::ErrLog << std::format("insert_range({},{}) fail.  {}\n", Index, Count, mz::db::db_time::now().string());
+                    return true;
+                }
+
+                while ((Next + Count - 1) / SegmentRows >= Segments)
+                {
+                    if (next_segment())
+                    {
+                        mz::ErrLog << std::format("insert_range(...) segment {} create error.  {}\n", Segments, mz::db::db_time::now().string());
+                        return true;
+                    }
+                }
+
+                if (write_rows(Index, Entries, Count))
+                {
+                    std::vector<T> Zero(std::min(Count, ReadRows));
+                    std::memset(static_cast<void*>(Zero.data()), 0, RecordSize * Zero.size());
+                    for (size_t Done = 0; Done < Count; Done += Zero.size()) {
+                        write_rows(Index + int64_t(Done), Zero.data(), std::min(Zero.size(), Count - Done));
+                    }
+                    return true;
+                }
+                NumIndexes.store(Next + Count, std::memory_order_release);
+                return false;
+            }
+
+
+            // the last row is zeroed and handed out again, rows of dropped segments are not
+            int64_t pop() noexcept
+            {
+                size_t Last = NumIndexes.load(std::memory_order_relaxed);
+                if (Last == 0 || int64_t(Last) <= first_index()) {
+                    return -1;
+                }
+                --Last;
+                T Zero;
+                std::memset(static_cast<void*>(&Zero), 0, RecordSize);
+                if (write_rows(int64_t(Last), &Zero, 1)) {
+                    return -1;
+                }
+                NumIndexes.store(Last, std::memory_order_release);
+                return int64_t(Last);
+            }
+
+
+
+            db_table_segmented() noexcept = default;
+            db_table_segmented(db_table_segmented const&) = delete;
+            db_table_segmented& operator = (db_table_segmented const&) = delete;
+
+            ~db_table_segmented() { close(); }
+
+
+            // opens the segments of Name, creating the first one for a new table. a last
+            // segment shorter than the others, left by a crash while creating it, is grown.
+            int open(std::filesystem::path const& Name, size_t max_indexes) noexcept
+            {
+                Source = Name.filename().string();
+                if (!Files.empty()) {
+                    close();
+                    Errors.open = 1;
+                    mz::ErrLog << std::format("storage[{}]::open: trying to reopen and open file\n", Name.string());
+                    return -3;
+                }
+
+                NumIndexes = 0;
+                MaxIndexes = 0;
+                FirstSegment = 0;
+                Segments = 0;
+                Cursor = 0;
+                Ahead.clear();
+                Errors.value = 0;
+                std::string ErrMsg2{ std::format("storage[{}]::open: ", Name.string()) };
+                if (Name.empty()) {
+                    Errors.open = 1;
+                    ErrMsg2 += "Name Empty\n";
+                    mz::ErrLog << ErrMsg2;
+                    return -1;
+                }
+
+                if (!max_indexes)
+                {
+                    Errors.open = 1;
+                    ErrMsg2 += "invalid maximum row numbers == 0\n";
+                    mz::ErrLog << ErrMsg2;
+                    return -4;
+                }
+
+                std::error_code Error;
+                auto Found = segment_files(Name, Error);
+                if (Error)
+                {
+                    Errors.open = 1;
+                    Errors.IO = 1;
+                    ErrMsg2 += std::format("failed to list segments: {}\n", Error.message());
+                    mz::ErrLog << ErrMsg2;
+                    return -6;
+                }
+
+                if (!Found.empty())
+                {
+                    int64_t Bytes = int64_t(std::filesystem::file_size(Found.front().second, Error));
+                    if (Error || Bytes < 0 || Bytes % int64_t(RecordSize) || (!Bytes && Found.size() > 1))
+                    {
+                        Errors.open = 1;
+                        Errors.Corrupted = 1;
+                        ErrMsg2 += std::format("segment size(={}) % RecordSize(={}) != 0\n", Bytes, RecordSize);
+                        mz::ErrLog << ErrMsg2;
+                        return -7;
+                    }
+                    if (Bytes) {
+                        SegmentRows = size_t(Bytes) / RecordSize;
+                    }
+                    if (Found.back().first - Found.front().first + 1 != Found.size())
+                    {
+                        Errors.open = 1;
+                        Errors.Corrupted = 1;
+                        ErrMsg2 += std::format("missing segments between {} and {}\n", Found.front().first, Found.back().first);
+                        mz::ErrLog << ErrMsg2;
+                        return -9;
+                    }
+                }
+
+                MaxIndexes = max_indexes;
+                FirstSegment = Found.empty() ? 0 : Found.front().first;
+                Segments = FirstSegment;
+                Slots = std::max(MaxIndexes / SegmentRows + 2, (Found.empty() ? 0 : Found.back().first) + 2);
+                while (Files.size() < Segments) {
+                    add_slot();
+                }
+
+                size_t Open = std::max<size_t>(Found.size(), 1);
+                for (size_t i = 0; i < Open; ++i)
+                {
+                    auto Path = segment_path(Name, Segments);
+                    add_slot();
+                    auto& File = Files[Segments];
+                    int64_t Size{ -1 };
+                    if (!File.create(Path) || (Size = File.size()) < 0 || Size > segment_bytes()
+                        || (Size < segment_bytes() && (i + 1 < Open || File.allocate(segment_bytes()))))
+                    {
+                        close();
+                        Errors.open = 1;
+                        Errors.Corrupted = Size >= 0;
+                        Errors.IO = Size < 0;
+                        ErrMsg2 += std::format("segment {} size(={}) != {}\n", Path.string(), Size, segment_bytes());
+                        mz::ErrLog << ErrMsg2;
+                        return -7;
+                    }
+                    ++Segments;
+                }
+                Base = Name;
+
+                // rows are contiguous and every record after them is zero
+                size_t Lo = FirstSegment * SegmentRows;
+                size_t Hi = Segments * SegmentRows;
+                while (Lo < Hi)
+                {
+                    size_t Mid = Lo + (Hi - Lo) / 2;
+                    T Entry;
+                    if (read_rows(int64_t(Mid), &Entry, 1))
+                    {
+                        close();
+                        Errors.open = 1;
+                        Errors.IO = 1;
+                        ErrMsg2 += std::format("read of row {} failed\n", Mid);
+                        mz::ErrLog << ErrMsg2;
+                        return -10;
+                    }
+                    if (is_zero(&Entry)) {
+                        Hi = Mid;
+                    }
+                    else {
+                        Lo = Mid + 1;
+                    }
+                }
+                NumIndexes = Lo;
+
+                if (Lo >= MaxIndexes)
+                {
+                    close();
+                    Errors.open = 1;
+                    Errors.IndexOverflow = 1;
+                    ErrMsg2 += std::format("NumIndex(={}) >= MaxIndexes(={})\n", Lo, MaxIndexes);
+                    mz::ErrLog << ErrMsg2;
+                    return -8;
+                }
+
+                prepare();
+                ErrMsg2.clear();
+                return 0;
+            }
+
+
+            // waits for the segment created ahead, which stays on disk for the next open()
+            void close() noexcept
+            {
+                if (Spare.valid()) {
+                    Spare.get();
+                }
+                Files.clear();
+                Dirty.clear();
+                Slots = 0;
+                Segments = 0;
+                NumIndexes = 0;
+                MaxIndexes = 0;
+                Ahead.clear();
+            }
+
+
+            // fdatasyncs the segments written since the last sync
+            bool sync() noexcept
+            {
+                for (size_t s = FirstSegment; s < Segments; ++s)
+                {
+                    if (Dirty[s].exchange(false, std::memory_order_acq_rel) && Files[s].datasync())
+                    {
+                        mz::ErrLog << std::format("db_table_segmented::sync() segment {} fail\n", s);
+                        Errors.write = 1;
+                        Dirty[s].store(true, std::memory_order_relaxed);
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+
+            // drops the first segment, deleting its file or, with Archive, moving it into that
+            // folder. the segment holding the last row is never dropped, so count() and the
+            // rows after first_index() are kept across open().
+            bool drop_segment(std::filesystem::path const& Archive = {}) noexcept
+            {
+                size_t First = FirstSegment.load(std::memory_order_relaxed);
+                if (!good() || (First + 1) * SegmentRows >= size_t(count()))
+                {
+                    mz::ErrLog << std::format("db_table_segmented::drop_segment({}) segment holds the last row\n", First);
+                    return true;
+                }
+
+                auto Path = segment_path(Base, First);
+                std::error_code Error;
+                if (Archive.empty()) {
+                    std::filesystem::remove(Path, Error);
+                }
+                else
+                {
+                    std::filesystem::create_directories(Archive, Error);
+                    if (!Error) {
+                        std::filesystem::rename(Path, Archive / Path.filename(), Error);
+                    }
+                }
+                if (Error)
+                {
+                    mz::ErrLog << std::format("db_table_segmented::drop_segment({}) {} error: {}\n", First, Path.string(), Error.message());
+                    return true;
+                }
+
+                FirstSegment.store(First + 1, std::memory_order_release);
+                Files[First].close();
+                Dirty[First].store(false, std::memory_order_relaxed);
+                return false;
+            }
+
+
+            // remove and rename all segment files of a table, used by db_table instead of
+            // std::filesystem to move a compacted table into place.
+            static void remove(std::filesystem::path const& Name, std::error_code& Error)
+            {
+                for (auto& [Segment, Path] : segment_files(Name, Error))
+                {
+                    if (!std::filesystem::remove(Path, Error) && Error) {
+                        return;
+                    }
+                }
+            }
+
+            static void rename(std::filesystem::path const& From, std::filesystem::path const& To, std::error_code& Error)
+            {
+                remove(To, Error);
+                if (Error) {
+                    return;
+                }
+                for (auto& [Segment, Path] : segment_files(From, Error))
+                {
+                    std::filesystem::rename(Path, segment_path(To, Segment), Error);
+                    if (Error) {
+                        return;
+                    }
+                }
+            }
+
+
+
+            // sequential access through a cursor, ReadRows rows are read at once. rows changed
+            // after they were read are seen after the next seekg_index().
+
+            bool select_next(T& Entry) const noexcept
+            {
+                if (Cursor < AheadFirst || Cursor >= AheadFirst + int64_t(Ahead.size()))
+                {
+                    if (Cursor < first_index() || Cursor >= count())
+                    {
+                        mz::ErrLog << std::format("select_next() read past end");
+                        Errors.read = 1;
+                        return true;
+                    }
+                    Ahead.resize(size_t(std::min<int64_t>(int64_t(ReadRows), count() - Cursor)));
+                    AheadFirst = Cursor;
+                    if (read_rows(Cursor, Ahead.data(), Ahead.size()))
+                    {
+                        mz::ErrLog << std::format("select_next() read fail");
+                        Ahead.clear();
+                        Errors.read = 1;
+                        return true;
+                    }
+                }
+                Entry = Ahead[size_t(Cursor++ - AheadFirst)];
+                return false;
+            }
+
+            bool seekg_index(int64_t Index) const noexcept
+            {
+                if (!good(Index))
+                {
+                    mz::ErrLog << std::format("seekg_index({}) not good", Index);
+                    return true;
+                }
+                Cursor = Index;
+                Ahead.clear();
+                return false;
+            }
+
+
+            bool good(size_t Index) const noexcept
+            {
+                if (Index < size_t(count()) && int64_t(Index) >= first_index())
+                {
+                    if (!Errors.value) {
+                        return true;
+                    }
+                    else {
+                        Errors.raise([](auto& E) { E.IO = 1; });
+                        mz::ErrLog << std::format("storage[{}]::good({}) Pre-Existing Errors:{}.  {}\n", Source, Index, Errors.value, mz::db::db_time::now().string());
+                        return false;
+                    }
+                }
+                else {
+                    db_events::post(db_event::storage_out_of_bounds, Source, int64_t(Index), count());
+                    return false;
+                }
+            }
+
+
+
+        protected:
+
+            std::filesystem::path Base;
+            // one entry per segment number up to Segments, added as segments open. a deque
+            // keeps the entries in place while it grows. Slots is the number of segments the
+            // row limit allows.
+            std::deque<db_native_file> Files;
+            std::deque<std::atomic<bool>> Dirty;
+            size_t Slots{ 0 };
+            std::future<db_native_file> Spare;      // segment Segments, being created
+            mutable std::vector<T> Ahead;
+            mutable int64_t AheadFirst{ 0 };
+
+
+            int64_t segment_bytes() const noexcept { return int64_t(SegmentRows * RecordSize); }
+
+            void add_slot()
+            {
+                Files.emplace_back();
+                Dirty.emplace_back(false);
+            }
+
+            static bool is_zero(entry_type const* Entry) noexcept
+            {
+                auto Bytes = reinterpret_cast<unsigned char const*>(Entry);
+                return std::all_of(Bytes, Bytes + RecordSize, [](unsigned char B) { return B == 0; });
+            }
+
+            // numbers and paths of the segment files of Name, in order
+            static std::vector<std::pair<size_t, std::filesystem::path>> segment_files(std::filesystem::path const& Name, std::error_code& Error)
+            {
+                std::vector<std::pair<size_t, std::filesystem::path>> Found;
+                auto Folder = Name.has_parent_path() ? Name.parent_path() : std::filesystem::path{ "." };
+                auto Prefix = Name.filename().string() + ".";
+                if (!std::filesystem::exists(Folder, Error)) {
+                    return Found;
+                }
+                for (auto const& Item : std::filesystem::directory_iterator{ Folder, Error })
+                {
+                    auto File = Item.path().filename().string();
+                    if (File.size() <= Prefix.size() || File.compare(0, Prefix.size(), Prefix)) {
+                        continue;
+                    }
+                    size_t Segment{ 0 };
+                    auto Digits = std::string_view{ File }.substr(Prefix.size());
+                    auto [End, Ec] = std::from_chars(Digits.data(), Digits.data() + Digits.size(), Segment);
+                    if (Ec == std::errc{} && End == Digits.data() + Digits.size()) {
+                        Found.emplace_back(Segment, Item.path());
+                    }
+                }
+                std::sort(Found.begin(), Found.end());
+                return Found;
+            }
+
+            static db_native_file create_segment(std::filesystem::path Path, int64_t Bytes) noexcept
+            {
+                db_native_file File;
+                if (File.create(Path) && File.allocate(Bytes))
+                {
+                    File.close();
+                    std::error_code Error;
+                    std::filesystem::remove(Path, Error);
+                }
+                return File;
+            }
+
+            // starts creating the segment after the one being appended to
+            void prepare()
+            {
+                if (Spare.valid() || Segments >= Slots || Segments > NumIndexes / SegmentRows + 1) {
+                    return;
+                }
+                try {
+                    Spare = std::async(std::launch::async, create_segment, segment_path(Base, Segments), segment_bytes());
+                }
+                catch (std::system_error const&) {
+                    // created by next_segment() when it is needed
+                }
+            }
+
+            // opens segment Segments, the one created ahead when it is ready
+            bool next_segment() noexcept
+            {
+                if (Segments >= Slots) {
+                    Errors.IndexOverflow = 1;
+                    return true;
+                }
+                auto File = Spare.valid() ? Spare.get() : create_segment(segment_path(Base, Segments), segment_bytes());
+                if (!File.is_open())
+                {
+                    Errors.IO = 1;
+                    return true;
+                }
+                add_slot();
+                Files[Segments] = std::move(File);
+                ++Segments;
+                prepare();
+                return false;
+            }
+
+
+            bool read_rows(int64_t Index, void* Data, size_t Count) const noexcept
+            {
+                auto Ptr = static_cast<char*>(Data);
+                while (Count)
+                {
+                    size_t Segment = size_t(Index) / SegmentRows;
+                    size_t At = size_t(Index) % SegmentRows;
+                    size_t Take = std::min(Count, SegmentRows - At);
+                    if (Files[Segment].read_at(Ptr, Take * RecordSize, int64_t(At * RecordSize)))
+                    {
+                        mz::ErrLog << std::format("storage[{}]::read_rows({},{}) segment {} read fail.  {}\n", Source, Index, Count, Segment, mz::db::db_time::now().string());
+                        Errors.raise([](auto& E) { E.read = 1; });
+                        return true;
+                    }
+                    IoStats.read(Take * RecordSize);
+                    Ptr += Take * RecordSize;
+                    Index += int64_t(Take);
+                    Count -= Take;
+                }
+                return false;
+            }
+
+            bool write_rows(int64_t Index, void const* Data, size_t Count) noexcept
+            {
+                auto Ptr = static_cast<char const*>(Data);
+                while (Count)
+                {
+                    size_t Segment = size_t(Index) / SegmentRows;
+                    size_t At = size_t(Index) % SegmentRows;
+                    size_t Take = std::min(Count, SegmentRows - At);
+                    if (Files[Segment].write_at(Ptr, Take * RecordSize, int64_t(At * RecordSize)))
+                    {
+                        mz::ErrLog << std::format("storage[{}]::write_rows({},{}) segment {} write fail.  {}\n", Source, Index, Count, Segment, mz::db::db_time::now().string());
+                        Errors.raise([](auto& E) { E.write = 1; });
+                        return true;
+                    }
+                    Dirty[Segment].store(true, std::memory_order_release);
+                    IoStats.wrote(Take * RecordSize);
+                    Ptr += Take * RecordSize;
+                    Index += int64_t(Take);
+                    Count -= Take;
+                }
+                return false;
+            }
+
+        };
+
+
+
+    }
+};
+
+
+
+
+
+#endif
@@ -0,0 +1,164 @@
+#ifndef DB_WRITE_LOG_HEADER_FILE
+#define DB_WRITE_LOG_HEADER_FILE
+#pragma once
+
+#include <span>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+#include "db_concepts.h"
+#include "db_file_io.h"
+#include "db_index_sidecar.h"
+
+namespace mz {
+    namespace db {
+
+
+        // write-ahead log of a table saved next to its data file as <data>.wal: a sequence
+        // of batches, each a header followed by Count (row, entry) records, appended with one
+        // write and one fdatasync. a batch whose header or checksum does not match, the tail
+        // of a crash, ends the log and is cut off by open(). records are row images, applying
+        // a batch again writes the same rows, so the log can be replayed any number of times.
+        // I/O functions return true on failure.
+        template <mz::db::TrivialType T>
+        class db_write_log
+        {
+        public:
+
+            static constexpr uint64_t Magic{ 0x314C4157445A4Dull };    // "MZDWAL1"
+
+            struct header
+            {
+                uint64_t Magic{ db_write_log::Magic };
+                uint32_t Count{ 0 };
+                uint32_t RecordSize{ uint32_t(sizeof(T)) };
+                uint64_t Sequence{ 0 };
+                uint64_t Checksum{ 0 };     // of the records
+            };
+
+            struct record
+            {
+                int64_t Index;
+                T Entry;
+            };
+
+
+            static std::filesystem::path path_of(std::filesystem::path const& Data)
+            {
+                auto Path = Data;
+                Path += ".wal";
+                return Path;
+            }
+
+
+            bool is_open() const noexcept { return File.is_open(); }
+
+            // bytes of complete batches in the log
+            int64_t size() const noexcept { return End; }
+
+
+            // opens or creates the log at Path and calls Apply(record const&) for every record
+            // of its complete batches in order, Apply returning true stops the replay and
+            // fails the open. a torn batch at the end is cut off.
+            bool open(std::filesystem::path const& Path, auto&& Apply)
+            {
+                close();
+                if (!File.create(Path)) {
+                    return true;
+                }
+                int64_t Size = File.size();
+                if (Size < 0) {
+                    return true;
+                }
+
+                std::vector<record> Records;
+                header Header{};
+                while (End + int64_t(sizeof(header)) <= Size)
+                {
+                    if (File.read_at(&Header, sizeof(Header), End)) {
+                        return true;
+                    }
+                    int64_t Bytes = int64_t(Header.Count) * int64_t(sizeof(record));
+                    if (Header.Magic != Magic || Header.RecordSize != sizeof(T) || End + int64_t(sizeof(header)) + Bytes > Size) {
+                        break;
+                    }
+                    Records.resize(Header.Count);
+                    if (File.read_at(Records.data(), size_t(Bytes), End + int64_t(sizeof(header)))) {
+                        return true;
+                    }
+                    if (db_checksum(Records.data(), size_t(Bytes)) != Header.Checksum) {
+                        break;
+                    }
+                    for (auto const& Record : Records)
+                    {
+                        if (Apply(Record)) {
+                            return true;
+                        }
+                    }
+                    Sequence = Header.Sequence + 1;
+                    End += int64_t(sizeof(header)) + Bytes;
+                }
+                return End != Size && File.resize(End);
+            }
+
+            void close() noexcept
+            {
+                File.close();
+                End = 0;
+                Sequence = 0;
+            }
+
+
+            // appends Records as one batch and syncs it, a failed append leaves the log as it was
+            bool append(std::span<record const> Records)
+            {
+                if (Records.empty()) {
+                    return false;
+                }
+                header Header{};
+                Header.Count = uint32_t(Records.size());
+                Header.Sequence = Sequence;
+                Header.Checksum = db_checksum(Records.data(), Records.size_bytes());
+
+                Buffer.resize(sizeof(header) + Records.size_bytes());
+                std::memcpy(Buffer.data(), &Header, sizeof(header));
+                std::memcpy(Buffer.data() + sizeof(header), Records.data(), Records.size_bytes());
+                if (File.write_at(Buffer.data(), Buffer.size(), End) || File.datasync())
+                {
+                    File.resize(End);
+                    return true;
+                }
+                End += int64_t(Buffer.size());
+                ++Sequence;
+                return false;
+            }
+
+            // empties the log once the data file holds every batch durably
+            bool reset() noexcept
+            {
+                if (!End) {
+                    return false;
+                }
+                if (File.resize(0) || File.datasync()) {
+                    return true;
+                }
+                End = 0;
+                return false;
+            }
+
+        private:
+
+            db_native_file File;
+            int64_t End{ 0 };
+            uint64_t Sequence{ 0 };
+            std::vector<unsigned char> Buffer;
+        };
+
+
+
+    }
+};
+
+#endif